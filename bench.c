@@ -0,0 +1,408 @@
+/*
+ * bench.c	compile time scaling benchmark
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * Authors:	Vadim Kochan <vadim4j@gmail.com>
+ */
+
+/*
+ * Compiles generated filters of a few families at growing sizes and fits
+ * how the time of each stage and the memory grow with the size (the
+ * exponent of n in a log-log least squares fit). A stage which grows faster than
+ * n log n does over the same sizes is reported. Each size is compiled by
+ * a child process, so its maximum RSS is the one of that compile.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "bench.h"
+#include "stats.h"
+#include "xmalloc.h"
+#include "compiler.h"
+
+#define BENCH_TERM_MAX	32
+/* the best time is taken, the first run also faults the heap in */
+#define BENCH_RUNS	3
+/* the smaller sizes are mostly the fixed costs */
+#define BENCH_FIT_MIN	1000
+/* noise allowed over the n log n exponent */
+#define BENCH_SLACK	0.15
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+
+static int bench_sizes[] = { 10, 100, 1000, 10000, 100000 };
+
+struct bench_expr {
+	char *str;
+	int len;
+};
+
+struct bench_family {
+	char *name;
+	void (*gen)(struct bench_expr *e, int n);
+};
+
+struct bench_point {
+	bool is_ok;
+	uint64_t stage_ns[STAGE_MAX];
+	/* peak IR memory of the whole compile, the stages overlap */
+	size_t mem_peak;
+	/* in kilobytes */
+	long rss;
+};
+
+static char *or_fields[] = {
+	"tcp.dport", "udp.sport", "ipv4.ttl", "tcp.flags",
+	"ipv4.len", "udp.dport", "ipv4.tos", "tcp.sport",
+};
+
+/* fields of a single protocol stack, so the compares are not dropped */
+static char *arith_fields[] = {
+	"tcp.sport", "ipv4.ttl", "tcp.flags", "ipv4.len", "ipv4.tos",
+};
+
+static char *arith_ops[] = { "+", "-", "*", "&", "|", "^", "<<", ">>" };
+
+static void bench_add(struct bench_expr *e, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	e->len += vsprintf(e->str + e->len, fmt, ap);
+	va_end(ap);
+}
+
+/* compares of different protocols fields */
+static void bench_or_gen(struct bench_expr *e, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		bench_add(e, "%s%s == %d", i ? " || " : "",
+				or_fields[i % ARRAY_SIZE(or_fields)], i);
+}
+
+/* one field in a set of values */
+static void bench_set_gen(struct bench_expr *e, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		bench_add(e, "%stcp.dport == %d", i ? " || " : "", i);
+}
+
+/* (((ipv4.ttl + 1) - ipv4.tos) * 3) ... */
+static void bench_nest_gen(struct bench_expr *e, int n)
+{
+	int i;
+
+	bench_add(e, "tcp.dport == ");
+	for (i = 0; i < n; i++)
+		bench_add(e, "(");
+
+	bench_add(e, "ipv4.ttl");
+	for (i = 0; i < n; i++) {
+		if (i % 2)
+			bench_add(e, " %c ipv4.tos)", "+-*|"[i % 4]);
+		else
+			bench_add(e, " %c %d)", "+-*|"[i % 4], i % 5 + 1);
+	}
+}
+
+/* tcp.dport - ipv4.ttl * 3 & ipv4.len | 5 ... == 1 */
+static void bench_arith_gen(struct bench_expr *e, int n)
+{
+	int i;
+
+	bench_add(e, "tcp.dport");
+	for (i = 1; i < n; i++) {
+		char *op = arith_ops[i % ARRAY_SIZE(arith_ops)];
+
+		if (i % 2)
+			bench_add(e, " %s %s", op,
+				arith_fields[i % ARRAY_SIZE(arith_fields)]);
+		else
+			bench_add(e, " %s %d", op, i % 7 + 1);
+	}
+	bench_add(e, " == 1");
+}
+
+static struct bench_family bench_families[] = {
+	{ "or",		bench_or_gen },
+	{ "nest",	bench_nest_gen },
+	{ "set",	bench_set_gen },
+	{ "arith",	bench_arith_gen },
+};
+
+static void bench_point_compile(struct bench_family *fam, int n,
+		bool do_optimize, struct bench_point *pt)
+{
+	struct compiler_stats stats;
+	struct bench_expr e;
+	struct sock_filter *f;
+	int i, r;
+
+	e.str = xmalloc(BENCH_TERM_MAX * (n + 1));
+	e.len = 0;
+	fam->gen(&e, n);
+
+	for (r = 0; r < BENCH_RUNS; r++) {
+		if (compile_filter(e.str, &f, do_optimize, &stats) <= 0)
+			goto out;
+		xfree(f);
+
+		for (i = 0; i < STAGE_MAX; i++) {
+			if (r == 0 || stats.stage_ns[i] < pt->stage_ns[i])
+				pt->stage_ns[i] = stats.stage_ns[i];
+		}
+		pt->mem_peak = stats.mem_peak;
+	}
+
+	pt->is_ok = true;
+out:
+	xfree(e.str);
+}
+
+static int bench_point_run(struct bench_family *fam, int n, bool do_optimize,
+		struct bench_point *pt)
+{
+	struct rusage ru;
+	int status;
+	int fds[2];
+	pid_t pid;
+
+	memset(pt, 0, sizeof(*pt));
+
+	if (pipe(fds)) {
+		perror("pipe");
+		return -1;
+	}
+
+	fflush(stdout);
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+
+	if (pid == 0) {
+		close(fds[0]);
+		bench_point_compile(fam, n, do_optimize, pt);
+		if (write(fds[1], pt, sizeof(*pt)) != sizeof(*pt))
+			_exit(1);
+		_exit(0);
+	}
+
+	close(fds[1]);
+	if (read(fds[0], pt, sizeof(*pt)) != sizeof(*pt))
+		pt->is_ok = false;
+	close(fds[0]);
+
+	if (wait4(pid, &status, 0, &ru) < 0) {
+		perror("wait4");
+		return -1;
+	}
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status))
+		pt->is_ok = false;
+	pt->rss = ru.ru_maxrss;
+	return 0;
+}
+
+/* exponent k of y = c * x^k by least squares over the logs */
+static double bench_fit(double *x, double *y, int count)
+{
+	double sx = 0, sy = 0, sxx = 0, sxy = 0;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		double lx = log(x[i]);
+		double ly = log(y[i] > 0 ? y[i] : 1);
+
+		sx += lx;
+		sy += ly;
+		sxx += lx * lx;
+		sxy += lx * ly;
+	}
+
+	return (count * sxy - sx * sy) / (count * sxx - sx * sx);
+}
+
+/* column values: stage times in ms, then peak IR memory and RSS in KB */
+#define BENCH_COL_PEAK	STAGE_MAX
+#define BENCH_COLS	(STAGE_MAX + 2)
+
+static double bench_col(struct bench_point *pt, int col)
+{
+	if (col < STAGE_MAX)
+		return pt->stage_ns[col] / 1e6;
+	if (col == BENCH_COL_PEAK)
+		return pt->mem_peak / 1024.0;
+
+	return pt->rss;
+}
+
+static const char *bench_col_name(int col)
+{
+	if (col < STAGE_MAX)
+		return stats_stage_name(col);
+	if (col == BENCH_COL_PEAK)
+		return "peak";
+
+	return "rss";
+}
+
+static bool bench_is_flagged(double slope, double nlogn_slope)
+{
+	return slope > nlogn_slope + BENCH_SLACK;
+}
+
+static void bench_table(const char *unit, int from, int to,
+		struct bench_point *pts, double *slope, double nlogn_slope,
+		bool has_fit)
+{
+	size_t i;
+	int col;
+
+	printf("  %-9s", unit);
+	for (col = from; col < to; col++)
+		printf(" %10s", bench_col_name(col));
+	printf("\n");
+
+	for (i = 0; i < ARRAY_SIZE(bench_sizes); i++) {
+		printf("  %-9d", bench_sizes[i]);
+		if (!pts[i].is_ok) {
+			printf(" %10s\n", "failed");
+			continue;
+		}
+
+		for (col = from; col < to; col++)
+			printf(" %10.*f", col < STAGE_MAX ? 3 : 0,
+					bench_col(&pts[i], col));
+		printf("\n");
+	}
+
+	if (!has_fit)
+		return;
+
+	printf("  %-9s", "exponent");
+	for (col = from; col < to; col++)
+		printf(" %9.2f%c", slope[col],
+			bench_is_flagged(slope[col], nlogn_slope) ? '!' : ' ');
+	printf("\n");
+}
+
+/* returns the number of the stages which grow too fast */
+static int bench_family_run(struct bench_family *fam, bool do_optimize)
+{
+	struct bench_point pts[ARRAY_SIZE(bench_sizes)];
+	double x[ARRAY_SIZE(bench_sizes)];
+	double y[ARRAY_SIZE(bench_sizes)];
+	double slope[BENCH_COLS];
+	double nlogn_slope;
+	int fit_count = 0;
+	int flagged = 0;
+	int failed = 0;
+	size_t i;
+	int col;
+
+	printf("%s:\n", fam->name);
+
+	for (i = 0; i < ARRAY_SIZE(bench_sizes); i++) {
+		if (bench_point_run(fam, bench_sizes[i], do_optimize, &pts[i]))
+			return -1;
+		if (!pts[i].is_ok)
+			failed++;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(bench_sizes); i++) {
+		if (!pts[i].is_ok || bench_sizes[i] < BENCH_FIT_MIN)
+			continue;
+
+		x[fit_count] = bench_sizes[i];
+		y[fit_count] = bench_sizes[i] * log(bench_sizes[i]);
+		fit_count++;
+	}
+
+	nlogn_slope = fit_count >= 2 ? bench_fit(x, y, fit_count) : 0;
+
+	for (col = 0; col < BENCH_COLS; col++) {
+		int k = 0;
+
+		for (i = 0; i < ARRAY_SIZE(bench_sizes); i++) {
+			if (!pts[i].is_ok || bench_sizes[i] < BENCH_FIT_MIN)
+				continue;
+			y[k++] = bench_col(&pts[i], col);
+		}
+
+		slope[col] = fit_count >= 2 ? bench_fit(x, y, fit_count) : 0;
+	}
+
+	bench_table("ms", 0, STAGE_MAX, pts, slope, nlogn_slope,
+			fit_count >= 2);
+	bench_table("KB", STAGE_MAX, BENCH_COLS, pts, slope, nlogn_slope,
+			fit_count >= 2);
+	if (fit_count >= 2)
+		printf("  n log n exponent %.2f\n", nlogn_slope);
+	printf("\n");
+
+	for (col = 0; col < BENCH_COLS && fit_count >= 2; col++) {
+		if (!bench_is_flagged(slope[col], nlogn_slope))
+			continue;
+
+		printf("warning: %s %s %s grows as n^%.2f\n", fam->name,
+				bench_col_name(col),
+				col < STAGE_MAX ? "time" : "memory", slope[col]);
+		flagged++;
+	}
+	if (failed)
+		printf("warning: %s failed to compile at %d sizes\n",
+				fam->name, failed);
+
+	return flagged + failed;
+}
+
+int bench_run(char *family, bool do_optimize)
+{
+	int flagged = 0;
+	bool found = false;
+	size_t i;
+	int ret;
+
+	/* the largest filters go past the kernel limit of instructions */
+	compile_verify_set(false);
+
+	for (i = 0; i < ARRAY_SIZE(bench_families); i++) {
+		struct bench_family *fam = &bench_families[i];
+
+		if (family && strcmp(family, fam->name) != 0)
+			continue;
+
+		found = true;
+		ret = bench_family_run(fam, do_optimize);
+		if (ret < 0)
+			return -1;
+		flagged += ret;
+	}
+
+	if (!found) {
+		fprintf(stderr, "error: unknown benchmark family '%s'\n",
+				family);
+		return -1;
+	}
+
+	return flagged ? -1 : 0;
+}
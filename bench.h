@@ -0,0 +1,8 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <stdbool.h>
+
+int bench_run(char *family, bool do_optimize);
+
+#endif
@@ -0,0 +1,234 @@
+/*
+ * clauses.c	incremental compiler for OR-of-clauses filters
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * Authors:	Vadim Kochan <vadim4j@gmail.com>
+ */
+
+/*
+ * Each clause is compiled and optimized on its own into a fragment whose
+ * drop exit is laid out last. Dropping that last instruction makes a
+ * failed clause fall through to the next one, so linking the whole
+ * filter is a concatenation of the fragments and an edit only recompiles
+ * the clause it touches.
+ *
+ * The fragments share nothing, each one has its own header offsets and
+ * protocol guards, so they are tested again by every clause a packet
+ * fails. The linked filter grows by that much per clause and runs into
+ * the kernel limit of instructions after a few hundred clauses, which is
+ * reported when it is linked.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bpf.h"
+#include "xmalloc.h"
+#include "verifier.h"
+#include "clauses.h"
+#include "compiler.h"
+
+#define CMD_LINE_MAX	65536
+
+struct clause_set *clause_set_alloc(bool do_optimize)
+{
+	struct clause_set *set = xmalloc(sizeof(*set));
+
+	memset(set, 0, sizeof(*set));
+	INIT_LIST_HEAD(&set->clauses);
+	set->do_optimize = do_optimize;
+	set->next_id = 1;
+	set->is_dirty = true;
+
+	return set;
+}
+
+static void clause_free(struct clause *cl)
+{
+	list_del(&cl->list);
+	xfree(cl->code);
+	free(cl->expr);
+	xfree(cl);
+}
+
+void clause_set_free(struct clause_set *set)
+{
+	struct clause *cl, *tmp;
+
+	list_for_each_entry_safe(cl, tmp, &set->clauses, list)
+		clause_free(cl);
+
+	if (set->code)
+		xfree(set->code);
+	xfree(set);
+}
+
+int clause_add(struct clause_set *set, char *expr)
+{
+	struct sock_filter *code;
+	struct clause *cl;
+	int len;
+
+	len = compile_fragment(expr, &code, set->do_optimize);
+	if (len <= 0)
+		return -1;
+
+	cl = xmalloc(sizeof(*cl));
+	cl->id = set->next_id++;
+	cl->expr = strdup(expr);
+	cl->code = code;
+	cl->len = len - 1;
+	list_add_tail(&cl->list, &set->clauses);
+
+	set->len += cl->len;
+	set->count++;
+	set->is_dirty = true;
+
+	return cl->id;
+}
+
+int clause_del(struct clause_set *set, int id)
+{
+	struct clause *cl;
+
+	list_for_each_entry(cl, &set->clauses, list) {
+		if (cl->id != id)
+			continue;
+
+		set->len -= cl->len;
+		set->count--;
+		set->is_dirty = true;
+
+		clause_free(cl);
+		return 0;
+	}
+
+	return -1;
+}
+
+static void clause_verify_report(int idx, const char *msg, void *arg)
+{
+	struct clause_set *set = arg;
+	struct clause *cl;
+	int offset = 0;
+
+	if (idx < 0) {
+		fprintf(stderr, "error: %s\n", msg);
+		return;
+	}
+
+	list_for_each_entry(cl, &set->clauses, list) {
+		if (idx < offset + cl->len) {
+			fprintf(stderr, "error: L%d: %s, in clause %d '%s'\n",
+					idx, msg, cl->id, cl->expr);
+			return;
+		}
+		offset += cl->len;
+	}
+
+	fprintf(stderr, "error: L%d: %s\n", idx, msg);
+}
+
+int clause_set_link(struct clause_set *set, struct sock_filter **f)
+{
+	struct sock_filter *code;
+	struct clause *cl;
+
+	if (!set->is_dirty)
+		goto out;
+
+	if (set->code)
+		xfree(set->code);
+	set->code = NULL;
+
+	set->code_len = set->len + 1;
+	set->code = code = xmalloc(sizeof(*code) * set->code_len);
+
+	list_for_each_entry(cl, &set->clauses, list) {
+		memcpy(code, cl->code, sizeof(*code) * cl->len);
+		code += cl->len;
+	}
+
+	/* the last clause falls through to here */
+	code->code = BPF_RET | BPF_K;
+	code->jt = code->jf = 0;
+	code->k = 0;
+
+	if (verify(set->code, set->code_len, clause_verify_report, set)) {
+		xfree(set->code);
+		set->code = NULL;
+		return -1;
+	}
+
+	set->is_dirty = false;
+out:
+	*f = set->code;
+	return set->code_len;
+}
+
+static char *cmd_arg(char *line, const char *cmd)
+{
+	size_t len = strlen(cmd);
+
+	if (strncmp(line, cmd, len) != 0)
+		return NULL;
+	if (line[len] != ' ' && line[len] != '\0')
+		return NULL;
+
+	line += len;
+	while (*line == ' ')
+		line++;
+
+	return line;
+}
+
+/*
+ * Line oriented protocol for a long-lived process:
+ *
+ *	add <expr>	compile clause, prints its id
+ *	del <id>	remove clause
+ *	show		dump the linked filter
+ */
+int clauses_run(bool do_optimize)
+{
+	struct clause_set *set = clause_set_alloc(do_optimize);
+	static char line[CMD_LINE_MAX];
+	struct sock_filter *f;
+	char *arg;
+	int len;
+	int id;
+
+	while (fgets(line, sizeof(line), stdin)) {
+		line[strcspn(line, "\n")] = '\0';
+
+		if ((arg = cmd_arg(line, "add"))) {
+			id = clause_add(set, arg);
+			if (id < 0)
+				printf("error: can't compile clause\n");
+			else
+				printf("%d\n", id);
+		} else if ((arg = cmd_arg(line, "del"))) {
+			if (clause_del(set, atoi(arg)))
+				printf("error: no such clause\n");
+			else
+				printf("ok\n");
+		} else if (cmd_arg(line, "show")) {
+			len = clause_set_link(set, &f);
+			if (len < 0)
+				printf("error: can't link clauses\n");
+			else
+				bpf_dump(f, len);
+		} else if (line[0] != '\0') {
+			printf("error: unknown command\n");
+		}
+
+		fflush(stdout);
+	}
+
+	clause_set_free(set);
+	return 0;
+}
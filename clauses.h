@@ -0,0 +1,41 @@
+#ifndef __CLAUSES_H__
+#define __CLAUSES_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <linux/filter.h>
+
+#include "list.h"
+
+struct clause {
+	struct list_head list;
+	int id;
+	char *expr;
+	/* compiled code without the trailing drop */
+	struct sock_filter *code;
+	int len;
+};
+
+struct clause_set {
+	struct list_head clauses;
+	bool do_optimize;
+	int next_id;
+	int count;
+	int len;
+
+	/* linked program, rebuilt on demand after an edit */
+	struct sock_filter *code;
+	int code_len;
+	bool is_dirty;
+};
+
+struct clause_set *clause_set_alloc(bool do_optimize);
+void clause_set_free(struct clause_set *set);
+
+int clause_add(struct clause_set *set, char *expr);
+int clause_del(struct clause_set *set, int id);
+int clause_set_link(struct clause_set *set, struct sock_filter **f);
+
+int clauses_run(bool do_optimize);
+
+#endif
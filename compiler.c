@@ -10,18 +10,28 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
 
 #include "proto.h"
+#include "stats.h"
+#include "htable.h"
 #include "xmalloc.h"
 #include "compiler.h"
 #include "optimizer.h"
+#include "peephole.h"
+#include "verifier.h"
 
 #define dbg(fmt, ...) printf("dbg: " fmt, ##__VA_ARGS__)
 
+#define JMP_OFFSET_MAX	255
+
 static int regs[REGS_MEM_MAX];
 
 static struct block *root_block;
+static struct block *drop_block;
 
 struct sock_filter *code_start;
 struct sock_filter *code_end;
@@ -30,6 +40,85 @@ static int instr_count;
 static int block_count;
 static struct list_head blocks;
 
+/* header offset: value of M[reg] (if reg is not negative) plus offset */
+struct hdr_offset {
+	int reg;
+	int offset;
+};
+
+/*
+ * Ends of variable length headers, computed once at the program start (or
+ * by the guards of the header if no walk is needed) and kept in M[] for the
+ * whole program.
+ */
+struct hdr_slot {
+	struct proto *proto;
+	int reg;
+	/* upper protocol found by the walk over extension headers (or inner) */
+	int next_reg;
+	/* offset of the variable length header itself */
+	struct hdr_offset offset;
+};
+
+static struct hdr_slot hdr_slots[REGS_MEM_MAX];
+static int hdr_slots_count;
+
+#define PROTOS_MAX	32
+#define GUARDS_MAX	64
+
+/* protocols referenced by the filter, indexed by expr->protos bits */
+static struct proto *protos[PROTOS_MAX];
+static int protos_count;
+
+typedef enum {
+	/* lower protocol tells it is the upper one */
+	GUARD_NEXT,
+	/* packet is not a non-first fragment of the lower protocol */
+	GUARD_FRAG,
+	/* lower protocol has a tag */
+	GUARD_TAG,
+	/* protocol present field is set */
+	GUARD_PRESENT,
+	/* the same test is done by other blocks */
+	GUARD_TEST,
+	/* length of the header is in M[] (always true) */
+	GUARD_LEN,
+} guard_t;
+
+/* implicit test that the protocol header is there (or a repeated test) */
+struct guard {
+	struct proto *proto;
+	guard_t type;
+};
+
+static struct guard guards[GUARDS_MAX];
+static int guards_count;
+
+/* source of the blocks built by the current parser action */
+static struct src_loc src_cur;
+static const char *src_text;
+
+/* block each emitted instruction comes from, for the verifier errors */
+static struct block **code_blocks;
+static bool do_verify = true;
+
+/* flow sharding tail: hash(shard_key) % shard_count == shard */
+static int shard_count;
+static char *shard_key;
+static struct block *shard_block;
+static int shard_jmp;
+
+/* clause of an OR-of-clauses filter, it accepts or falls through */
+static bool is_fragment;
+
+/* filters merged into one program, each one tried after the previous */
+static char **union_exprs;
+static int union_count;
+static int union_idx;
+static bool union_match_index;
+static struct block *union_blk;
+static struct block *union_accept;
+
 static inline int reg_get()
 {
 	int reg = 0;
@@ -45,6 +134,22 @@ static inline int reg_get()
 	return -1;
 }
 
+/* registers which live for the whole program are taken from the top */
+static inline int reg_reserve(void)
+{
+	int reg = REGS_MEM_MAX - 1;
+
+	for (; reg >= 0; reg--) {
+		if (!regs[reg]) {
+			regs[reg] = 1;
+			return reg;
+		}
+	}
+
+	printf("no free registers\n");
+	return -1;
+}
+
 static inline void reg_put(uint8_t reg)
 {
 	regs[reg] = 0;
@@ -73,7 +178,7 @@ static void instr_insert(struct instr *list, struct instr *ins)
 
 static void instr_join(struct instr *to, struct instr *from)
 {
-	list_join_tail(&from->list, &to->list);
+	list_join_tail_init(&from->list, &to->list);
 }
 
 static struct instr *instr_val_load(uint32_t val)
@@ -86,6 +191,11 @@ static struct instr *instr_store_a_mem(int mem)
 	return instr_alloc(BPF_ST, 0, 0, mem);
 }
 
+static struct instr *instr_store_x_mem(int mem)
+{
+	return instr_alloc(BPF_STX, 0, 0, mem);
+}
+
 static struct instr *instr_load_mem_x(int mem)
 {
 	return instr_alloc(BPF_LDX | BPF_MEM, 0, 0, mem);
@@ -96,16 +206,39 @@ static struct instr *instr_load_mem_a(int mem)
 	return instr_alloc(BPF_LD | BPF_MEM, 0, 0, mem);
 }
 
-static struct instr *instr_load_offset(int offset, int size)
+static int size_to_bpf(int size)
 {
-	int bpf_size = BPF_B;
-
 	if (size == 2)
-		bpf_size = BPF_H;
+		return BPF_H;
 	else if (size == 4)
-		bpf_size = BPF_W;
+		return BPF_W;
+
+	return BPF_B;
+}
+
+static int bpf_to_size(int code)
+{
+	if (BPF_SIZE(code) == BPF_H)
+		return 2;
+	else if (BPF_SIZE(code) == BPF_W)
+		return 4;
+
+	return 1;
+}
+
+static struct instr *instr_load_offset(int offset, int size)
+{
+	return instr_alloc(BPF_LD | BPF_IND | size_to_bpf(size), 0, 0, offset);
+}
 
-	return instr_alloc(BPF_LD | BPF_IND | bpf_size, 0, 0, offset);
+static struct instr *instr_load_abs(int offset, int size)
+{
+	return instr_alloc(BPF_LD | BPF_ABS | size_to_bpf(size), 0, 0, offset);
+}
+
+static struct instr *instr_tax(void)
+{
+	return instr_alloc(BPF_MISC | BPF_TAX, 0, 0, 0);
 }
 
 static struct instr *instr_alu_x_a(int code)
@@ -113,6 +246,11 @@ static struct instr *instr_alu_x_a(int code)
 	return instr_alloc(BPF_ALU | BPF_X | code, 0, 0, 0);
 }
 
+static struct instr *instr_alu_k_a(int code, uint32_t k)
+{
+	return instr_alloc(BPF_ALU | BPF_K | code, 0, 0, k);
+}
+
 static int instr_count_calc(struct instr *list)
 {
 	struct list_head *pos;
@@ -141,6 +279,7 @@ static int oper_to_jmp_code(oper_t op)
 		jmp_code = BPF_JGT;
 		break;
 	case OP_EQ:
+	case OP_NEQ:
 		jmp_code = BPF_JEQ;
 		break;
 	case OP_GR:
@@ -163,10 +302,12 @@ static int oper_to_bpf_code(oper_t op)
 	case OP_SUB: return BPF_SUB;
 	case OP_MUL: return BPF_MUL;
 	case OP_DIV: return BPF_DIV;
+	case OP_MOD: return BPF_MOD;
 	case OP_LSH: return BPF_LSH;
 	case OP_RSH: return BPF_RSH;
 	case OP_BAND: return BPF_AND;
 	case OP_BOR: return BPF_OR;
+	case OP_BXOR: return BPF_XOR;
 	}
 
 	return -1;
@@ -178,26 +319,62 @@ static struct block *block_alloc(void)
 	memset(blk, 0, sizeof(*blk));
 
 	blk->root = blk;
+	blk->offset = -1;
+	blk->src = src_cur;
 	blk->instrs = xmalloc(sizeof(struct instr));
 	INIT_LIST_HEAD(&blk->instrs->list);
 	INIT_LIST_HEAD(&blk->list);
 	block_count++;
 
-	if (block_count == 1)
-		INIT_LIST_HEAD(&blocks);
-
 	list_add_tail(&blk->list, &blocks);
 	return blk;
 }
 
+void src_text_set(const char *text)
+{
+	src_text = text;
+	src_loc_set(0, 0, 0);
+}
+
+void src_loc_set(int line, int first, int last)
+{
+	src_cur.text = src_text;
+	src_cur.line = line;
+	src_cur.first = first;
+	src_cur.last = last;
+}
+
+static void instrs_free(struct instr *list)
+{
+	struct instr *ins, *tmp;
+
+	list_for_each_entry_safe(ins, tmp, &list->list, list)
+		xfree(ins);
+
+	xfree(list);
+}
+
 static void block_free(struct block *blk)
 {
 	if (!blk)
 		return;
 
+	instrs_free(blk->instrs);
+	if (blk->jmp_instr)
+		xfree(blk->jmp_instr);
 	xfree(blk);
 }
 
+static void blocks_free(struct list_head *list)
+{
+	struct block *blk, *tmp;
+
+	list_for_each_entry_safe(blk, tmp, list, list)
+		block_free(blk);
+
+	INIT_LIST_HEAD(list);
+}
+
 static struct block *build_return(int retcode)
 {
 	struct block *blk = block_alloc();
@@ -216,316 +393,2560 @@ static struct block *build_accept(void)
 	return build_return(-1);
 }
 
+/* with the instructions which are not joined to a block */
+static void expr_free(struct expr *e)
+{
+	instrs_free(e->instrs);
+	xfree(e);
+}
+
 static struct expr *expr_alloc(void)
 {
 	struct expr *e	= xmalloc(sizeof(struct expr));
 
+	e->protos = 0;
+	e->is_present = false;
+	e->is_number = false;
+	e->is_wide = false;
+	e->wide_field = NULL;
+
 	e->instrs = xmalloc(sizeof(struct instr));
 	INIT_LIST_HEAD(&e->instrs->list);
 
 	return e;
 }
 
-static void backpatch(struct block *l, struct block *r, bool list)
+static void jmp_list_init(struct jmp_list *list, struct jmp_node *jmp)
 {
-	struct block *next;
-	struct block *blk = l;
-
-	while (blk) {
-		if (list == true) {
-			next = blk->jmp_true.target;
-			blk->jmp_true.target = r;
-		} else {
-			next = blk->jmp_false.target;
-			blk->jmp_false.target = r;
-		}
-		blk = next;
-	}
+	jmp->next = NULL;
+	list->head = list->tail = jmp;
 }
 
-static void merge(struct block *left, struct block *right, bool list)
+static void jmp_list_join(struct jmp_list *to, struct jmp_list *from)
 {
-	struct block *blk = right;
-	struct jmp_node *jmp = list == true ? &blk->jmp_true : &blk->jmp_false;
-
-	while (jmp->target) {
-		if (list == true)
-			jmp = &jmp->target->jmp_true;
-		else
-			jmp = &jmp->target->jmp_false;
+	if (!from->head)
+		return;
+	if (!to->head) {
+		*to = *from;
+		return;
 	}
-	jmp->target = left;
-}
 
-static bool block_has_jmp(struct block *blk, bool jmp_type)
-{
-	return !!(jmp_type == true ? blk->jmp_true.target :
-		blk->jmp_false.target);
+	to->tail->next = from->head;
+	to->tail = from->tail;
 }
 
-static int jmp_offset_calc(struct block *blk, int ins_count, bool jmp_type)
+static void backpatch(struct jmp_list *list, struct block *target)
 {
-	struct block *target;
-
-	if (jmp_type == true)
-		target = blk->jmp_true.target;
-	else
-		target = blk->jmp_false.target;
-
-	if (!target)
-		return 0;
+	struct jmp_node *jmp;
 
-	return target->offset - (blk->offset + ins_count);
+	for (jmp = list->head; jmp; jmp = jmp->next)
+		jmp->target = target;
 }
 
-struct block *block_build(struct expr *e)
+/* test which always holds, it has no false exit */
+static struct block *build_true(void)
 {
 	struct block *blk = block_alloc();
 
-	instr_join(blk->instrs, e->instrs);
-
-	xfree(e);
+	blk->jmp_instr = instr_alloc(BPF_JMP | BPF_JA, 0, 0, 0);
+	jmp_list_init(&blk->true_list, &blk->jmp_true);
 	return blk;
 }
 
-struct block *branch_merge(oper_t op, struct block *left, struct block *right)
+static void branch_lists_init(struct block *blk, bool is_reversed)
 {
-	if (op == OP_LOR) {
-		backpatch(left, right, left->is_reversed);
-		merge(left, right, !left->is_reversed);
-	} if (op == OP_LAND) {
-		backpatch(left, right, !left->is_reversed);
-		merge(left, right, left->is_reversed);
+	if (is_reversed) {
+		jmp_list_init(&blk->true_list, &blk->jmp_false);
+		jmp_list_init(&blk->false_list, &blk->jmp_true);
+	} else {
+		jmp_list_init(&blk->true_list, &blk->jmp_true);
+		jmp_list_init(&blk->false_list, &blk->jmp_false);
 	}
-
-	right->root = left->root;
-	return right;
 }
 
-struct block *branch_not(struct block *blk)
+static int guard_get(struct proto *proto, guard_t type)
 {
-	blk->is_reversed = !blk->is_reversed;
-}
+	int i;
 
-struct block *branch_build(oper_t jmp_op, struct expr *left, struct expr *right)
-{
-	struct block *blk = block_alloc();
+	for (i = 0; i < guards_count; i++) {
+		if (guards[i].proto == proto && guards[i].type == type)
+			return i;
+	}
 
-	if (jmp_op == OP_LE || jmp_op == OP_LEQ)
-		blk->is_reversed = true;
+	if (guards_count == GUARDS_MAX)
+		return -1;
 
-	blk->jmp_instr = instr_alloc(oper_to_jmp_code(jmp_op), 0, 0, 0);
+	guards[i].proto = proto;
+	guards[i].type = type;
+	guards_count++;
+	return i;
+}
 
-	instr_join(blk->instrs, left->instrs);
-	instr_join(blk->instrs, right->instrs);
+static struct expr *expr_field(struct proto_field *field);
+static int proto_hdr_offset(struct proto *p, struct hdr_offset *off);
+static int proto_index(struct proto *p);
+static int hdr_slot_get(struct proto *p, struct hdr_offset *off);
+static void hdr_len_build(struct instr *list, struct proto *p,
+		struct hdr_offset *off, int reg);
 
-	instr_insert(blk->instrs, instr_load_mem_a(left->reg));
-	instr_insert(blk->instrs, instr_load_mem_x(right->reg));
+static struct hdr_slot *hdr_slot_find(struct proto *p)
+{
+	int i;
 
-	reg_put(left->reg);
-	reg_put(right->reg);
-	xfree(left);
-	xfree(right);
+	for (i = 0; i < hdr_slots_count; i++) {
+		if (hdr_slots[i].proto == p)
+			return &hdr_slots[i];
+	}
 
-	return blk;
+	return NULL;
 }
 
-struct expr *expr_build(oper_t op, struct expr *left, struct expr *right)
+/* length within the header, no walk needed */
+static bool hdr_slot_is_len(struct hdr_slot *slot)
 {
-	int ret_reg = reg_get();
-	int old_reg = left->reg;
+	struct proto *p = slot->proto;
 
-	instr_join(left->instrs, right->instrs);
+	return !p->tags.max && !p->ext.max && !p->encaps;
+}
 
-	instr_insert(left->instrs, instr_load_mem_a(left->reg));
-	instr_insert(left->instrs, instr_load_mem_x(right->reg));
-	instr_insert(left->instrs, instr_alu_x_a(oper_to_bpf_code(op)));
-	instr_insert(left->instrs, instr_store_a_mem(ret_reg));
+/*
+ * The walk over the lower's extension headers (or the decode of the
+ * encapsulation) tells the upper protocol.
+ */
+static struct block *guard_ext_build(struct proto *p)
+{
+	struct hdr_offset off;
+	struct block *blk;
 
-	left->reg = ret_reg;
-	reg_put(old_reg);
-	reg_put(right->reg);
+	proto_hdr_offset(p, &off);
 
-	xfree(right);
-	return left;
+	blk = block_alloc();
+	instr_insert(blk->instrs,
+			instr_load_mem_a(hdr_slot_find(p->lower)->next_reg));
+	blk->jmp_instr = instr_alloc(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, p->id);
+	branch_lists_init(blk, false);
+	return blk;
 }
 
-struct expr *expr_add(struct expr *l, struct expr *r)
+static struct block *guard_block_build(struct proto *p, guard_t type)
 {
-	return expr_build(OP_ADD, l, r);
-}
+	struct hdr_offset off;
+	struct hdr_slot *slot;
+	struct block *blk;
+
+	switch (type) {
+	case GUARD_NEXT:
+		if ((p->lower->ext.max && p->demux == p->lower->next) ||
+				p->lower->encaps) {
+			blk = guard_ext_build(p);
+			break;
+		}
 
-struct expr *expr_sub(struct expr *l, struct expr *r)
-{
-	return expr_build(OP_SUB, l, r);
-}
+		blk = branch_build(OP_EQ, expr_field(p->demux),
+				expr_number(p->id));
+		break;
+	case GUARD_FRAG:
+		blk = branch_build(OP_EQ, expr_field(p->frag), expr_number(0));
+		break;
+	case GUARD_TAG:
+		proto_hdr_offset(p, &off);
+		hdr_slot_get(p, &off);
+
+		/* M[] keeps the length of the tags */
+		blk = block_alloc();
+		instr_insert(blk->instrs, instr_load_mem_a(off.reg));
+		blk->jmp_instr = instr_alloc(BPF_JMP | BPF_JGT | BPF_K, 0, 0, 0);
+		branch_lists_init(blk, false);
+		break;
+	case GUARD_PRESENT:
+		blk = block_build(expr_field(p->present));
+		break;
+	case GUARD_LEN:
+		slot = hdr_slot_find(p);
 
-struct expr *expr_mul(struct expr *l, struct expr *r)
-{
-	return expr_build(OP_MUL, l, r);
-}
+		blk = build_true();
+		hdr_len_build(blk->instrs, p, &slot->offset, slot->reg);
+		break;
+	case GUARD_TEST:
+	default:
+		/* repeated tests are made guards after they are built */
+		fprintf(stderr, "error: guard type %d has no test\n", type);
+		abort();
+	}
 
-struct expr *expr_div(struct expr *l, struct expr *r)
-{
-	return expr_build(OP_DIV, l, r);
+	return blk;
 }
 
-struct expr *expr_and(struct expr *l, struct expr *r)
+static struct block *guard_add(struct block *blk, struct proto *p,
+		guard_t type, uint64_t *built)
 {
-	return expr_build(OP_BAND, l, r);
+	int guard = guard_get(p, type);
+	struct block *test;
+
+	/* the length is needed anyway, it is just not threaded */
+	if (guard < 0 && type != GUARD_LEN)
+		return blk;
+	if (guard >= 0 && (*built & (1ULL << guard)))
+		return blk;
+
+	test = guard_block_build(p, type);
+	if (guard >= 0) {
+		test->guard = guard + 1;
+		*built |= 1ULL << guard;
+	}
+
+	return blk ? branch_merge(OP_LAND, blk, test) : test;
 }
 
-struct expr *expr_or(struct expr *l, struct expr *r)
+static struct block *guard_chain_build(struct proto *p, struct block *blk,
+		uint64_t *built)
 {
-	return expr_build(OP_BOR, l, r);
+	struct proto *lower = p->lower;
+	struct hdr_slot *slot;
+
+	if (p->present)
+		blk = guard_add(blk, p, GUARD_PRESENT, built);
+
+	if (!lower)
+		return blk;
+
+	blk = guard_chain_build(lower, blk, built);
+
+	if (p->is_tag)
+		return guard_add(blk, lower, GUARD_TAG, built);
+
+	if (p->demux || lower->encaps)
+		blk = guard_add(blk, p, GUARD_NEXT, built);
+	if (lower->frag)
+		blk = guard_add(blk, lower, GUARD_FRAG, built);
+
+	/* the length is read only once the header is known to be there */
+	slot = hdr_slot_find(p);
+	if (slot && hdr_slot_is_len(slot))
+		blk = guard_add(blk, p, GUARD_LEN, built);
+
+	return blk;
 }
 
-struct expr *expr_xor(struct expr *l, struct expr *r)
+static struct block *guards_chain_build(uint32_t mask)
 {
-	return expr_build(OP_BXOR, l, r);
+	struct block *blk = NULL;
+	uint64_t built = 0;
+	int i;
+
+	for (i = 0; i < protos_count; i++) {
+		if (mask & (1U << i))
+			blk = guard_chain_build(protos[i], blk, &built);
+	}
+
+	return blk;
 }
 
-struct expr *expr_lsh(struct expr *l, struct expr *r)
+/* the test only holds if headers of all its protocols are there */
+static struct block *guards_build(uint32_t mask, struct block *test)
 {
-	return expr_build(OP_LSH, l, r);
+	struct block *blk = guards_chain_build(mask);
+
+	if (!blk)
+		return test;
+
+	return branch_merge(OP_LAND, blk, test);
 }
 
-struct expr *expr_rsh(struct expr *l, struct expr *r)
+static bool expr_wide_check(struct expr *l, struct expr *r)
 {
-	return expr_build(OP_RSH, l, r);
+	if (!l->is_wide && (!r || !r->is_wide))
+		return true;
+
+	fprintf(stderr, "error: 128 bit values can only be compared\n");
+	return false;
 }
 
-struct expr *expr_offset(struct expr *e, int size)
+struct block *block_build(struct expr *e)
 {
-	int ret_reg = reg_get();
-	int old_reg = e->reg;
+	uint32_t mask = e->protos;
+	struct block *blk;
 
-	instr_insert(e->instrs, instr_load_mem_x(e->reg));
-	instr_insert(e->instrs, instr_load_offset(0, size));
-	instr_insert(e->instrs, instr_store_a_mem(ret_reg));
+	if (!expr_wide_check(e, NULL))
+		return NULL;
 
-	reg_put(old_reg);
-	e->reg = ret_reg;
+	/* the guards are the test, it holds if the protocol is always there */
+	if (e->is_present) {
+		reg_put(e->reg);
+		expr_free(e);
 
-	return e;
-}
+		blk = guards_chain_build(mask);
+		return blk ? blk : build_true();
+	}
 
-struct expr *expr_number(unsigned int value)
-{
-	struct expr *e	= expr_alloc();
-	e->reg = reg_get();
+	blk = block_alloc();
 
-	instr_insert(e->instrs, instr_val_load((uint32_t)value));
-	instr_insert(e->instrs, instr_store_a_mem(e->reg));
+	instr_join(blk->instrs, e->instrs);
+	instr_insert(blk->instrs, instr_load_mem_a(e->reg));
 
-	return e;
-}
+	/* non zero value is true */
+	blk->jmp_instr = instr_alloc(BPF_JMP | BPF_JGT | BPF_K, 0, 0, 0);
+	branch_lists_init(blk, false);
 
-struct expr *expr_proto(char *name)
-{
-	struct expr *e;
-	e = xmalloc(sizeof(struct block));
-	return e;
+	reg_put(e->reg);
+	expr_free(e);
+	return guards_build(mask, blk);
 }
 
-struct expr *expr_proto_offset(char *name, struct expr *e)
+struct block *branch_merge(oper_t op, struct block *left, struct block *right)
 {
-	return expr_build(OP_INDX, expr_proto(name), e);
+	if (op == OP_LOR) {
+		backpatch(&left->false_list, right->root);
+		jmp_list_join(&left->true_list, &right->true_list);
+		right->true_list = left->true_list;
+	} else if (op == OP_LAND) {
+		backpatch(&left->true_list, right->root);
+		jmp_list_join(&left->false_list, &right->false_list);
+		right->false_list = left->false_list;
+	}
+
+	right->root = left->root;
+	return right;
 }
 
-void parse_finish(struct block *blk)
+struct block *branch_not(struct block *blk)
 {
-	if (!blk)
-		printf("parse_finish: input block is NULL\n");
+	struct jmp_list tmp = blk->true_list;
 
-	backpatch(blk, build_accept(), !blk->is_reversed);
-	backpatch(blk, build_drop(), blk->is_reversed);
+	blk->true_list = blk->false_list;
+	blk->false_list = tmp;
 
-	root_block = blk->root;
-	if (!root_block)
-		printf("parse_finish: no root\n");
+	return blk;
 }
 
-static void compile_block(struct block *blk)
+static struct block *__branch_build(oper_t jmp_op, struct expr *left,
+		struct expr *right)
 {
-	struct sock_filter *code;
-	struct list_head *pos;
-	int ins_count;
+	struct block *blk = block_alloc();
 
-	if (!blk || blk->offset)
-		return;
+	blk->jmp_instr = instr_alloc(oper_to_jmp_code(jmp_op), 0, 0, 0);
+	branch_lists_init(blk, jmp_op == OP_LE || jmp_op == OP_LEQ ||
+			jmp_op == OP_NEQ);
 
-	compile_block(blk->jmp_false.target);
-	compile_block(blk->jmp_true.target);
+	instr_join(blk->instrs, left->instrs);
+	instr_join(blk->instrs, right->instrs);
 
-	ins_count = instr_count_calc(blk->instrs);
-	ins_count += blk->jmp_instr ? 1 : 0;
+	instr_insert(blk->instrs, instr_load_mem_a(left->reg));
+	instr_insert(blk->instrs, instr_load_mem_x(right->reg));
 
-	code = code_end -= ins_count;
-	blk->offset = code - code_start;
+	reg_put(left->reg);
+	reg_put(right->reg);
+	expr_free(left);
+	expr_free(right);
 
-	list_for_each(pos, &blk->instrs->list) {
-		struct instr *ins = container_of(pos, struct instr, list);
+	return blk;
+}
 
-		if (ins->is_optimized)
-			continue;
+/*
+ * 128 bit field is compared by 32 bit words, starting from the last one
+ * which usually differs the most.
+ */
+static struct block *branch_wide_build(oper_t jmp_op, struct expr *left,
+		struct expr *right)
+{
+	struct expr *field = left->wide_field ? left : right;
+	struct expr *addr = left->wide_field ? right : left;
+	struct block *blk = NULL;
+	int i;
+
+	if ((jmp_op != OP_EQ && jmp_op != OP_NEQ) || !field->wide_field ||
+			addr->wide_field || !addr->is_wide) {
+		fprintf(stderr, "error: 128 bit field can only be compared "
+				"(== or !=) with an address\n");
+		return NULL;
+	}
 
-		code->code = ins->code;
-		code->jt = ins->jt;
-		code->jf = ins->jf;
-		code->k = ins->k;
-		code++;
+	for (i = 3; i >= 0; i--) {
+		struct proto_field word = *field->wide_field;
+		struct block *test;
+
+		word.offset += i * 4;
+		word.len = 4;
+
+		test = __branch_build(OP_EQ, expr_field(&word),
+				expr_number(addr->wide_addr[i]));
+		blk = blk ? branch_merge(OP_LAND, blk, test) : test;
 	}
 
-	if (!blk->jmp_instr)
-		return;
+	expr_free(left);
+	expr_free(right);
 
-	if (block_has_jmp(blk, true))
-		code->jt = jmp_offset_calc(blk, ins_count, true);
-	else
-		code->jt = blk->jmp_instr->jt;
+	return jmp_op == OP_NEQ ? branch_not(blk) : blk;
+}
+
+struct block *branch_build(oper_t jmp_op, struct expr *left, struct expr *right)
+{
+	uint32_t mask = left->protos | right->protos;
+	struct block *blk;
 
-	if (block_has_jmp(blk, false))
-		code->jf = jmp_offset_calc(blk, ins_count, false);
+	if (left->is_wide || right->is_wide)
+		blk = branch_wide_build(jmp_op, left, right);
 	else
-		code->jf = blk->jmp_instr->jf;
+		blk = __branch_build(jmp_op, left, right);
+	if (!blk)
+		return NULL;
 
-	code->code = blk->jmp_instr->code;
-	code->k = blk->jmp_instr->k;
+	return guards_build(mask, blk);
 }
 
-static void compiler_init(struct compiler *comp)
+#define PATTERN_LEN_MAX		256
+#define PATTERN_OFFSETS_MAX	64
+
+struct pattern_word {
+	int offset;
+	int size;
+	uint32_t val;
+	int bits;
+};
+
+static int hex_digit(char c)
 {
-	memset(comp, 0, sizeof(*comp));
-	INIT_LIST_HEAD(&comp->blocks);
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
 }
 
-int compile_filter(char *expr, struct sock_filter **filter, bool do_optimize)
+/* "text" with C escapes or x"hex digits", spaces between the digits */
+static int pattern_parse(char *str, uint8_t *data)
 {
-	struct compiler comp;
+	bool is_hex = *str == 'x' || *str == 'X';
+	int len = 0;
+	int hi, lo;
 
-	compiler_init(&comp);
+	str += is_hex ? 2 : 1;
 
-	parse_filter(expr);
+	while (*str && *str != '"') {
+		if (len == PATTERN_LEN_MAX)
+			return -1;
 
-	if (!root_block)
-		return 0;
-	if (instr_count == 0)
-		return 0;
+		if (is_hex) {
+			if (*str == ' ' || *str == '\t') {
+				str++;
+				continue;
+			}
+
+			hi = hex_digit(str[0]);
+			lo = hex_digit(str[1]);
+			if (hi < 0 || lo < 0)
+				return -1;
+
+			data[len++] = hi << 4 | lo;
+			str += 2;
+			continue;
+		}
+
+		if (*str != '\\') {
+			data[len++] = *str++;
+			continue;
+		}
+
+		str++;
+		switch (*str) {
+		case 'n':
+			data[len++] = '\n';
+			break;
+		case 'r':
+			data[len++] = '\r';
+			break;
+		case 't':
+			data[len++] = '\t';
+			break;
+		case '0':
+			data[len++] = 0;
+			break;
+		case 'x':
+			hi = hex_digit(str[1]);
+			lo = hex_digit(str[2]);
+			if (hi < 0 || lo < 0)
+				return -1;
+
+			data[len++] = hi << 4 | lo;
+			str += 2;
+			break;
+		default:
+			data[len++] = *str;
+			break;
+		}
+		str++;
+	}
+
+	return len;
+}
+
+/* rough guess of how much a byte tells, zeros and spaces are common */
+static int pattern_byte_bits(uint8_t c)
+{
+	if (c == 0 || c == 0xff || c == ' ')
+		return 2;
+	if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+		return 5;
+	return 8;
+}
+
+static int pattern_word_cmp(const void *a, const void *b)
+{
+	const struct pattern_word *wa = a;
+	const struct pattern_word *wb = b;
+
+	if (wa->bits != wb->bits)
+		return wb->bits - wa->bits;
+	return wa->offset - wb->offset;
+}
+
+/*
+ * Splits the pattern into the fewest loads: words, the last one overlaps
+ * the previous if needed, shorter patterns take a half word and a byte.
+ * The most selective load is tested first.
+ */
+static int pattern_split(uint8_t *data, int len, struct pattern_word *words)
+{
+	struct pattern_word *w;
+	int count = 0;
+	int i, j;
+
+	for (i = 0; i < len; i += w->size) {
+		w = &words[count++];
+
+		w->offset = i;
+		if (len - i >= 4) {
+			w->size = 4;
+		} else if (len >= 4) {
+			w->offset = len - 4;
+			w->size = 4;
+		} else {
+			w->size = len - i >= 2 ? 2 : 1;
+		}
+
+		w->val = 0;
+		w->bits = 0;
+		for (j = 0; j < w->size; j++) {
+			w->val = w->val << 8 | data[w->offset + j];
+			w->bits += pattern_byte_bits(data[w->offset + j]);
+		}
+	}
+
+	qsort(words, count, sizeof(*words), pattern_word_cmp);
+	return count;
+}
+
+static struct block *pattern_word_build(struct hdr_offset *off, int offset,
+		struct pattern_word *w)
+{
+	struct block *blk = block_alloc();
+
+	offset += off->offset + w->offset;
+	if (off->reg >= 0) {
+		instr_insert(blk->instrs, instr_load_mem_x(off->reg));
+		instr_insert(blk->instrs, instr_load_offset(offset, w->size));
+	} else {
+		instr_insert(blk->instrs, instr_load_abs(offset, w->size));
+	}
+
+	blk->jmp_instr = instr_alloc(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, w->val);
+	branch_lists_init(blk, false);
+	return blk;
+}
+
+/*
+ * PROTO[offset:len] == "pattern": bytes from the start of the header are
+ * compared by words. A window longer than the pattern is searched, each
+ * offset in it is tested by an unrolled compare.
+ */
+struct block *pattern_build(char *name, int offset, int len, oper_t op,
+		char *str)
+{
+	struct pattern_word words[PATTERN_LEN_MAX / 4 + 2];
+	struct proto *proto = proto_lookup(name);
+	uint8_t data[PATTERN_LEN_MAX];
+	struct block *blk = NULL;
+	struct hdr_offset off;
+	int count, plen;
+	int idx, i, n;
+
+	if (!proto) {
+		fprintf(stderr, "error: unknown protocol '%s'\n", name);
+		return NULL;
+	}
+	if (op != OP_EQ && op != OP_NEQ) {
+		fprintf(stderr, "error: pattern can only be compared (== or !=)\n");
+		return NULL;
+	}
+
+	plen = pattern_parse(str, data);
+	if (plen <= 0) {
+		fprintf(stderr, "error: wrong pattern %s\n", str);
+		return NULL;
+	}
+	if (len < plen) {
+		fprintf(stderr, "error: pattern %s is longer than %d\n", str, len);
+		return NULL;
+	}
+	if (len - plen >= PATTERN_OFFSETS_MAX) {
+		fprintf(stderr, "error: pattern %s is searched at more than %d "
+				"offsets\n", str, PATTERN_OFFSETS_MAX);
+		return NULL;
+	}
+
+	idx = proto_index(proto);
+	if (idx < 0 || proto_hdr_offset(proto, &off))
+		return NULL;
+
+	count = pattern_split(data, plen, words);
+
+	for (n = offset; n <= offset + len - plen; n++) {
+		struct block *test = NULL;
+
+		for (i = 0; i < count; i++) {
+			struct block *word = pattern_word_build(&off, n, &words[i]);
+
+			test = test ? branch_merge(OP_LAND, test, word) : word;
+		}
+
+		blk = blk ? branch_merge(OP_LOR, blk, test) : test;
+	}
+
+	if (op == OP_NEQ)
+		blk = branch_not(blk);
+
+	return guards_build(1U << idx, blk);
+}
+
+struct expr *expr_build(oper_t op, struct expr *left, struct expr *right)
+{
+	int old_reg = left->reg;
+	int ret_reg;
+
+	if (!expr_wide_check(left, right))
+		return NULL;
+
+	ret_reg = reg_get();
+
+	instr_join(left->instrs, right->instrs);
+	left->protos |= right->protos;
+
+	instr_insert(left->instrs, instr_load_mem_a(left->reg));
+	instr_insert(left->instrs, instr_load_mem_x(right->reg));
+	instr_insert(left->instrs, instr_alu_x_a(oper_to_bpf_code(op)));
+	instr_insert(left->instrs, instr_store_a_mem(ret_reg));
+
+	left->reg = ret_reg;
+	left->is_present = false;
+	left->is_number = false;
+	reg_put(old_reg);
+	reg_put(right->reg);
+
+	expr_free(right);
+	return left;
+}
+
+struct expr *expr_add(struct expr *l, struct expr *r)
+{
+	return expr_build(OP_ADD, l, r);
+}
+
+struct expr *expr_sub(struct expr *l, struct expr *r)
+{
+	return expr_build(OP_SUB, l, r);
+}
+
+struct expr *expr_mul(struct expr *l, struct expr *r)
+{
+	return expr_build(OP_MUL, l, r);
+}
+
+/* the kernel refuses the program with a constant 0 divisor */
+static bool expr_divisor_check(struct expr *r, const char *op)
+{
+	if (r->is_number && !r->number) {
+		fprintf(stderr, "error: %s by constant 0\n", op);
+		return false;
+	}
+
+	return true;
+}
+
+struct expr *expr_div(struct expr *l, struct expr *r)
+{
+	if (!expr_divisor_check(r, "division"))
+		return NULL;
+
+	return expr_build(OP_DIV, l, r);
+}
+
+struct expr *expr_mod(struct expr *l, struct expr *r)
+{
+	if (!expr_divisor_check(r, "modulo"))
+		return NULL;
+
+	return expr_build(OP_MOD, l, r);
+}
+
+struct expr *expr_and(struct expr *l, struct expr *r)
+{
+	return expr_build(OP_BAND, l, r);
+}
+
+struct expr *expr_or(struct expr *l, struct expr *r)
+{
+	return expr_build(OP_BOR, l, r);
+}
+
+struct expr *expr_xor(struct expr *l, struct expr *r)
+{
+	return expr_build(OP_BXOR, l, r);
+}
+
+struct expr *expr_lsh(struct expr *l, struct expr *r)
+{
+	return expr_build(OP_LSH, l, r);
+}
+
+struct expr *expr_rsh(struct expr *l, struct expr *r)
+{
+	return expr_build(OP_RSH, l, r);
+}
+
+static struct expr *expr_load_ind(struct expr *e, int offset, int size)
+{
+	int old_reg = e->reg;
+	int ret_reg;
+
+	if (!expr_wide_check(e, NULL))
+		return NULL;
+
+	ret_reg = reg_get();
+
+	instr_insert(e->instrs, instr_load_mem_x(e->reg));
+	instr_insert(e->instrs, instr_load_offset(offset, size));
+	instr_insert(e->instrs, instr_store_a_mem(ret_reg));
+
+	reg_put(old_reg);
+	e->reg = ret_reg;
+	e->is_present = false;
+	e->is_number = false;
+
+	return e;
+}
+
+struct expr *expr_offset(struct expr *e, int size)
+{
+	return expr_load_ind(e, 0, size);
+}
+
+struct expr *expr_number(unsigned int value)
+{
+	struct expr *e	= expr_alloc();
+	e->reg = reg_get();
+	e->is_number = true;
+	e->number = value;
+
+	instr_insert(e->instrs, instr_val_load((uint32_t)value));
+	instr_insert(e->instrs, instr_store_a_mem(e->reg));
+
+	return e;
+}
+
+/* the decode needs offsets of the encapsulations, reserved before its own */
+static int hdr_inner_reserve(struct proto *p)
+{
+	struct hdr_offset off;
+	int i;
+
+	for (i = 0; p->encaps[i]; i++) {
+		if (proto_hdr_offset(p->encaps[i], &off))
+			return -1;
+	}
+
+	return 0;
+}
+
+/* M[] register which keeps the variable part of the header length */
+static int hdr_slot_get(struct proto *p, struct hdr_offset *off)
+{
+	struct hdr_slot *slot;
+	int i;
+
+	for (i = 0; i < hdr_slots_count; i++) {
+		if (hdr_slots[i].proto == p)
+			break;
+	}
+
+	if (i == hdr_slots_count) {
+		if (p->tags.max && off->reg >= 0) {
+			fprintf(stderr, "error: tags of '%s' at variable offset\n",
+					p->name);
+			return -1;
+		}
+
+		/* slots are built in order, after the ones they depend on */
+		if (p->encaps && hdr_inner_reserve(p))
+			return -1;
+
+		i = hdr_slots_count;
+		slot = &hdr_slots[i];
+
+		slot->reg = reg_reserve();
+		if (slot->reg < 0)
+			return -1;
+
+		slot->next_reg = -1;
+		if (p->ext.max || p->encaps) {
+			slot->next_reg = reg_reserve();
+			if (slot->next_reg < 0)
+				return -1;
+		}
+
+		slot->proto = p;
+		slot->offset = *off;
+		hdr_slots_count++;
+	}
+
+	off->reg = hdr_slots[i].reg;
+	return 0;
+}
+
+static int proto_hdr_offset(struct proto *p, struct hdr_offset *off)
+{
+	struct proto *lower = p->lower;
+
+	off->reg = -1;
+	off->offset = 0;
+
+	if (!lower)
+		return 0;
+
+	if (proto_hdr_offset(lower, off))
+		return -1;
+
+	if (p->is_tag) {
+		off->offset += lower->tags.offset;
+		return 0;
+	}
+
+	if ((lower->var_len.mask || lower->opts.len || lower->tags.max ||
+				lower->ext.max || lower->encaps) &&
+			hdr_slot_get(lower, off))
+		return -1;
+
+	off->offset += lower->hdr_len;
+	return 0;
+}
+
+/* A = ((hdr[offset] & mask) >> ctz(mask)) * scale, X = header offset reg */
+static void hdr_part_build(struct instr *list, struct hdr_offset *off,
+		int offset, int size, int mask, int scale)
+{
+	int shift = __builtin_ctz(mask);
+
+	offset += off->offset;
+	if (off->reg >= 0) {
+		instr_insert(list, instr_load_mem_x(off->reg));
+		instr_insert(list, instr_load_offset(offset, size));
+	} else {
+		instr_insert(list, instr_load_abs(offset, size));
+	}
+	instr_insert(list, instr_alu_k_a(BPF_AND, mask));
+
+	/* scale by a power of two folds into the shift */
+	if (!(scale & (scale - 1))) {
+		shift -= __builtin_ctz(scale);
+		if (shift > 0)
+			instr_insert(list, instr_alu_k_a(BPF_RSH, shift));
+		else if (shift < 0)
+			instr_insert(list, instr_alu_k_a(BPF_LSH, -shift));
+	} else {
+		if (shift)
+			instr_insert(list, instr_alu_k_a(BPF_RSH, shift));
+		instr_insert(list, instr_alu_k_a(BPF_MUL, scale));
+	}
+}
+
+/* M[reg] = variable length of the header (+ its own offset) */
+static void hdr_len_build(struct instr *list, struct proto *p,
+		struct hdr_offset *off, int reg)
+{
+	struct proto_len *len = &p->var_len;
+	struct proto_opts *opts = &p->opts;
+	bool is_first = true;
+	int i;
+
+	if (off->reg < 0 && !opts->len && len->mask == 0xf && len->scale == 4) {
+		instr_insert(list, instr_alloc(BPF_LDX | BPF_B | BPF_MSH,
+					0, 0, off->offset + len->offset));
+		instr_insert(list, instr_store_x_mem(reg));
+		return;
+	}
+
+	if (len->mask) {
+		hdr_part_build(list, off, len->offset, 1, len->mask,
+				len->scale);
+		if (off->reg >= 0)
+			instr_insert(list, instr_alu_x_a(BPF_ADD));
+		instr_insert(list, instr_store_a_mem(reg));
+		is_first = false;
+	}
+
+	/* the optional parts are summed up */
+	for (i = 0; opts->len && i < PROTO_OPTS_FLAGS && opts->flags[i]; i++) {
+		hdr_part_build(list, off, opts->offset, 2, opts->flags[i],
+				opts->len);
+		if (is_first && off->reg >= 0)
+			instr_insert(list, instr_alu_x_a(BPF_ADD));
+		if (!is_first) {
+			instr_insert(list, instr_load_mem_x(reg));
+			instr_insert(list, instr_alu_x_a(BPF_ADD));
+		}
+		instr_insert(list, instr_store_a_mem(reg));
+		is_first = false;
+	}
+}
+
+static struct block *build_jmp(struct block *target)
+{
+	struct block *blk = block_alloc();
+
+	blk->jmp_instr = instr_alloc(BPF_JMP | BPF_JA, 0, 0, 0);
+	blk->jmp_true.target = target;
+	return blk;
+}
+
+/* M[reg] = length of the tags, walking at most tags->max of them */
+static struct block *hdr_tags_build(struct hdr_slot *slot, struct block *next)
+{
+	struct proto_tags *tags = &slot->proto->tags;
+	struct block *found = NULL;
+	int first = 0;
+	int n, i;
+
+	while (first < PROTO_TAG_IDS - 1 && !tags->ids[first])
+		first++;
+
+	/* from the deepest tag up, each level jumps to the next one */
+	for (n = tags->max; n >= 0; n--) {
+		int offset = slot->offset.offset + tags->offset + n * tags->len;
+		struct block *miss = build_jmp(next);
+
+		instr_insert(miss->instrs, instr_val_load(n * tags->len));
+		instr_insert(miss->instrs, instr_store_a_mem(slot->reg));
+
+		if (n == tags->max) {
+			found = miss;
+			continue;
+		}
+
+		for (i = PROTO_TAG_IDS - 1; i >= 0; i--) {
+			struct block *blk;
+
+			if (!tags->ids[i])
+				continue;
+
+			/* the next blocks test the same A */
+			blk = block_alloc();
+			if (i == first)
+				instr_insert(blk->instrs, instr_load_abs(offset, 2));
+			blk->jmp_instr = instr_alloc(BPF_JMP | BPF_JEQ | BPF_K,
+					0, 0, tags->ids[i]);
+			blk->jmp_true.target = found;
+			blk->jmp_false.target = miss;
+			miss = blk;
+		}
+
+		found = miss;
+	}
+
+	return found;
+}
+
+static struct block *guard_chain_build(struct proto *p, struct block *blk,
+		uint64_t *built);
+
+/*
+ * M[next_reg] = upper protocol and M[reg] = length of the extension headers
+ * (+ the own variable offset), walking at most ext->max of them. The walk
+ * is unrolled and keeps its state in the registers. It only runs if the
+ * protocol is there, otherwise the registers are just initialized.
+ */
+static struct block *hdr_ext_build(struct hdr_slot *slot, struct block *next)
+{
+	struct proto *p = slot->proto;
+	struct proto_ext *ext = &p->ext;
+	int offset = slot->offset.offset + p->hdr_len;
+	struct block *miss, *level, *start, *chain;
+	uint64_t built = 0;
+	int n, i;
+
+	/* from the deepest header up, each level jumps to the next one */
+	level = next;
+	for (n = ext->max - 1; n >= 0; n--) {
+		struct block *hop = build_jmp(level);
+		struct block *frag = NULL;
+		struct block *test = next;
+
+		instr_insert(hop->instrs, instr_load_mem_x(slot->reg));
+		instr_insert(hop->instrs, instr_load_offset(offset, 1));
+		instr_insert(hop->instrs, instr_store_a_mem(slot->next_reg));
+		instr_insert(hop->instrs, instr_load_offset(offset + 1, 1));
+		instr_insert(hop->instrs, instr_alu_k_a(BPF_ADD, 1));
+		instr_insert(hop->instrs, instr_alu_k_a(BPF_LSH, 3));
+		instr_insert(hop->instrs, instr_alu_x_a(BPF_ADD));
+		instr_insert(hop->instrs, instr_store_a_mem(slot->reg));
+
+		/* upper header of a non first fragment is not there */
+		if (ext->frag_id) {
+			struct block *stop = build_jmp(next);
+
+			instr_insert(stop->instrs, instr_val_load(ext->frag_id));
+			instr_insert(stop->instrs,
+					instr_store_a_mem(slot->next_reg));
+
+			frag = block_alloc();
+			instr_insert(frag->instrs, instr_load_mem_x(slot->reg));
+			instr_insert(frag->instrs,
+					instr_load_offset(offset + 2, 2));
+			frag->jmp_instr = instr_alloc(BPF_JMP | BPF_JSET | BPF_K,
+					0, 0, 0xfff8);
+			frag->jmp_true.target = stop;
+			frag->jmp_false.target = hop;
+		}
+
+		for (i = PROTO_EXT_IDS - 1; i >= 0; i--) {
+			struct block *blk;
+
+			if (!ext->ids[i] && i)
+				continue;
+
+			/* the next blocks test the same A */
+			blk = block_alloc();
+			if (i == 0)
+				instr_insert(blk->instrs,
+					instr_load_mem_a(slot->next_reg));
+			blk->jmp_instr = instr_alloc(BPF_JMP | BPF_JEQ | BPF_K,
+					0, 0, ext->ids[i]);
+			blk->jmp_true.target = ext->ids[i] == ext->frag_id &&
+				frag ? frag : hop;
+			blk->jmp_false.target = test;
+			test = blk;
+		}
+
+		level = test;
+	}
+
+	start = build_jmp(level);
+	if (slot->offset.reg >= 0) {
+		instr_insert(start->instrs, instr_load_mem_x(slot->offset.reg));
+		instr_insert(start->instrs, instr_store_x_mem(slot->reg));
+		instr_insert(start->instrs, instr_load_offset(
+				slot->offset.offset + p->next->offset,
+				p->next->len));
+	} else {
+		instr_insert(start->instrs, instr_val_load(0));
+		instr_insert(start->instrs, instr_store_a_mem(slot->reg));
+		instr_insert(start->instrs, instr_load_abs(
+				slot->offset.offset + p->next->offset,
+				p->next->len));
+	}
+	instr_insert(start->instrs, instr_store_a_mem(slot->next_reg));
+
+	chain = guard_chain_build(p, NULL, &built);
+	if (!chain)
+		return start;
+
+	/* only to have the registers initialized */
+	miss = build_jmp(next);
+	instr_insert(miss->instrs, instr_val_load(0));
+	instr_insert(miss->instrs, instr_store_a_mem(slot->next_reg));
+	instr_insert(miss->instrs, instr_store_a_mem(slot->reg));
+
+	backpatch(&chain->true_list, start);
+	backpatch(&chain->false_list, miss);
+	return chain->root;
+}
+
+/* M[reg] = header offset + k */
+static void hdr_offset_store(struct instr *list, struct hdr_offset *off,
+		int k, int reg)
+{
+	if (off->reg >= 0) {
+		instr_insert(list, instr_load_mem_a(off->reg));
+		instr_insert(list, instr_alu_k_a(BPF_ADD, off->offset + k));
+	} else {
+		instr_insert(list, instr_val_load(off->offset + k));
+	}
+	instr_insert(list, instr_store_a_mem(reg));
+}
+
+/* M[reg] = offset of the end of the header */
+static void hdr_end_build(struct instr *list, struct proto *p,
+		struct hdr_offset *off, int reg)
+{
+	if (!p->var_len.mask && !p->opts.len) {
+		hdr_offset_store(list, off, p->hdr_len, reg);
+		return;
+	}
+
+	hdr_len_build(list, p, off, reg);
+	instr_insert(list, instr_load_mem_a(reg));
+	instr_insert(list, instr_alu_k_a(BPF_ADD, off->offset + p->hdr_len));
+	instr_insert(list, instr_store_a_mem(reg));
+}
+
+/* ethernet frame at M[reg]: its type and the header which follows it */
+static struct block *hdr_inner_ether_build(struct hdr_slot *slot,
+		struct block *next)
+{
+	struct block *blk = build_jmp(next);
+
+	instr_insert(blk->instrs, instr_load_mem_x(slot->reg));
+	instr_insert(blk->instrs, instr_load_offset(ETH_ALEN * 2, 2));
+	instr_insert(blk->instrs, instr_store_a_mem(slot->next_reg));
+	instr_insert(blk->instrs, instr_alloc(BPF_MISC | BPF_TXA, 0, 0, 0));
+	instr_insert(blk->instrs, instr_alu_k_a(BPF_ADD, ETH_HLEN));
+	instr_insert(blk->instrs, instr_store_a_mem(slot->reg));
+	return blk;
+}
+
+/* unrolled walk down to the bottom of the label stack */
+static struct block *hdr_labels_build(struct hdr_slot *slot, struct proto *p,
+		struct hdr_offset *off, struct block *next)
+{
+	struct block *none, *ipv4, *ipv6, *is_ipv6, *bottom, *level;
+	int n;
+
+	none = build_jmp(next);
+	instr_insert(none->instrs, instr_val_load(0));
+	instr_insert(none->instrs, instr_store_a_mem(slot->next_reg));
+
+	ipv4 = build_jmp(next);
+	instr_insert(ipv4->instrs, instr_val_load(ETH_P_IP));
+	instr_insert(ipv4->instrs, instr_store_a_mem(slot->next_reg));
+
+	ipv6 = build_jmp(next);
+	instr_insert(ipv6->instrs, instr_val_load(ETH_P_IPV6));
+	instr_insert(ipv6->instrs, instr_store_a_mem(slot->next_reg));
+
+	/* tests the same A */
+	is_ipv6 = block_alloc();
+	is_ipv6->jmp_instr = instr_alloc(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 6);
+	is_ipv6->jmp_true.target = ipv6;
+	is_ipv6->jmp_false.target = none;
+
+	bottom = block_alloc();
+	instr_insert(bottom->instrs, instr_load_mem_a(slot->reg));
+	instr_insert(bottom->instrs, instr_alu_k_a(BPF_ADD, p->hdr_len));
+	instr_insert(bottom->instrs, instr_store_a_mem(slot->reg));
+	instr_insert(bottom->instrs, instr_tax());
+	instr_insert(bottom->instrs, instr_load_offset(0, 1));
+	instr_insert(bottom->instrs, instr_alu_k_a(BPF_RSH, 4));
+	bottom->jmp_instr = instr_alloc(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 4);
+	bottom->jmp_true.target = ipv4;
+	bottom->jmp_false.target = is_ipv6;
+
+	/* too deep stack is not decoded */
+	level = none;
+	for (n = p->encap.max - 1; n >= 0; n--) {
+		struct block *hop = build_jmp(level);
+		struct block *blk = block_alloc();
+
+		instr_insert(hop->instrs, instr_load_mem_a(slot->reg));
+		instr_insert(hop->instrs, instr_alu_k_a(BPF_ADD, p->hdr_len));
+		instr_insert(hop->instrs, instr_store_a_mem(slot->reg));
+
+		instr_insert(blk->instrs, instr_load_mem_x(slot->reg));
+		instr_insert(blk->instrs, instr_load_offset(2, 1));
+		blk->jmp_instr = instr_alloc(BPF_JMP | BPF_JSET | BPF_K,
+				0, 0, 1);
+		blk->jmp_true.target = bottom;
+		blk->jmp_false.target = hop;
+		level = blk;
+	}
+
+	/* the stack starts with the header itself */
+	level = build_jmp(level);
+	hdr_offset_store(level->instrs, off, 0, slot->reg);
+	return level;
+}
+
+/* decode of the encapsulation which is known to be there */
+static struct block *hdr_encap_build(struct hdr_slot *slot, struct proto *p,
+		struct block *next)
+{
+	struct proto_field *type = p->encap.type_field;
+	struct block *blk, *ether;
+	struct hdr_offset off;
+
+	proto_hdr_offset(p, &off);
+
+	switch (p->encap.type) {
+	case ENCAP_ETHER:
+		blk = build_jmp(hdr_inner_ether_build(slot, next));
+		hdr_end_build(blk->instrs, p, &off, slot->reg);
+		return blk;
+	case ENCAP_TYPE:
+		blk = block_alloc();
+		if (off.reg >= 0) {
+			instr_insert(blk->instrs, instr_load_mem_x(off.reg));
+			instr_insert(blk->instrs, instr_load_offset(
+					off.offset + type->offset, type->len));
+		} else {
+			instr_insert(blk->instrs, instr_load_abs(
+					off.offset + type->offset, type->len));
+		}
+		instr_insert(blk->instrs, instr_store_a_mem(slot->next_reg));
+		hdr_end_build(blk->instrs, p, &off, slot->reg);
+
+		ether = hdr_inner_ether_build(slot, next);
+		instr_insert(blk->instrs, instr_load_mem_a(slot->next_reg));
+		blk->jmp_instr = instr_alloc(BPF_JMP | BPF_JEQ | BPF_K,
+				0, 0, ETH_P_TEB);
+		blk->jmp_true.target = ether;
+		blk->jmp_false.target = next;
+		return blk;
+	case ENCAP_LABELS:
+		return hdr_labels_build(slot, p, &off, next);
+	default:
+		return next;
+	}
+}
+
+/*
+ * M[reg] = offset of the inner header and M[next_reg] = its protocol, from
+ * the first encapsulation which is there, both are zero without any. The
+ * inner fields are then loaded relative to M[reg] as any other header.
+ */
+static struct block *hdr_inner_build(struct hdr_slot *slot, struct block *next)
+{
+	struct proto **encaps = slot->proto->encaps;
+	struct block *test, *decode, *chain;
+	int n, i;
+
+	test = build_jmp(next);
+	instr_insert(test->instrs, instr_val_load(0));
+	instr_insert(test->instrs, instr_store_a_mem(slot->next_reg));
+	instr_insert(test->instrs, instr_store_a_mem(slot->reg));
+
+	for (n = 0; encaps[n]; n++)
+		;
+
+	for (i = n - 1; i >= 0; i--) {
+		uint64_t built = 0;
+
+		decode = hdr_encap_build(slot, encaps[i], next);
+		chain = guard_chain_build(encaps[i], NULL, &built);
+		if (!chain) {
+			test = decode;
+			continue;
+		}
+
+		backpatch(&chain->true_list, decode);
+		backpatch(&chain->false_list, test);
+		test = chain->root;
+	}
+
+	return test;
+}
+
+/*
+ * Length within the header for a read without guards, zero if the header
+ * is not there. The guards end with the length (GUARD_LEN).
+ */
+static struct block *hdr_var_build(struct hdr_slot *slot, struct block *next)
+{
+	struct block *miss, *chain;
+	uint64_t built = 0;
+
+	chain = guard_chain_build(slot->proto, NULL, &built);
+
+	miss = build_jmp(next);
+	instr_insert(miss->instrs, instr_val_load(0));
+	instr_insert(miss->instrs, instr_store_a_mem(slot->reg));
+
+	backpatch(&chain->true_list, next);
+	backpatch(&chain->false_list, miss);
+	return chain->root;
+}
+
+/*
+ * Header offsets of the walks over tags, extension headers and the inner
+ * headers are computed once, before anything else is run, each one after
+ * the offsets it depends on. Lengths within a header are only read once it
+ * is known to be there, so they are computed by the guards of their header
+ * instead, on the paths which read them.
+ */
+static struct block *hdr_slots_build(struct block *root)
+{
+	struct hdr_slot *slot;
+	int i;
+
+	for (i = hdr_slots_count - 1; i >= 0; i--) {
+		slot = &hdr_slots[i];
+
+		if (slot->proto->tags.max)
+			root = hdr_tags_build(slot, root);
+		else if (slot->proto->ext.max)
+			root = hdr_ext_build(slot, root);
+		else if (slot->proto->encaps)
+			root = hdr_inner_build(slot, root);
+	}
+
+	return root;
+}
+
+static int proto_index(struct proto *p)
+{
+	int i;
+
+	for (i = 0; i < protos_count; i++) {
+		if (protos[i] == p)
+			return i;
+	}
+
+	if (protos_count == PROTOS_MAX) {
+		fprintf(stderr, "error: too many protocols\n");
+		return -1;
+	}
+
+	protos[protos_count] = p;
+	return protos_count++;
+}
+
+/* the field is at M[off->reg] + off->offset, or at off->offset without reg */
+static int field_offset(struct proto_field *field, struct hdr_offset *off)
+{
+	if (proto_hdr_offset(field->proto, off))
+		return -1;
+	if (field->after_tags && field->proto->tags.max &&
+			hdr_slot_get(field->proto, off))
+		return -1;
+
+	off->offset += field->offset;
+	return 0;
+}
+
+static struct expr *expr_field(struct proto_field *field)
+{
+	struct hdr_offset off;
+	struct expr *e;
+	int offset;
+
+	if (field_offset(field, &off))
+		return NULL;
+
+	e = expr_alloc();
+	e->reg = reg_get();
+
+	offset = off.offset;
+	if (off.reg >= 0) {
+		instr_insert(e->instrs, instr_load_mem_x(off.reg));
+		instr_insert(e->instrs, instr_load_offset(offset, field->len));
+	} else {
+		instr_insert(e->instrs, instr_load_abs(offset, field->len));
+	}
+
+	/* sub-byte (or sub-word) field */
+	if (field->mask) {
+		int shift = __builtin_ctz(field->mask);
+
+		instr_insert(e->instrs, instr_alu_k_a(BPF_AND, field->mask));
+		if (shift)
+			instr_insert(e->instrs, instr_alu_k_a(BPF_RSH, shift));
+	}
+
+	instr_insert(e->instrs, instr_store_a_mem(e->reg));
+	return e;
+}
+
+static struct expr *expr_wide_addr(struct in6_addr *addr)
+{
+	struct expr *e = expr_alloc();
+	int i;
+
+	e->reg = -1;
+	e->is_wide = true;
+	for (i = 0; i < 4; i++)
+		e->wide_addr[i] = ntohl(addr->s6_addr32[i]);
+
+	return e;
+}
+
+/* 1 if the protocol header is there, tested by its guards */
+static struct expr *expr_present(struct proto *p)
+{
+	int idx = proto_index(p);
+	struct expr *e;
+
+	if (idx < 0)
+		return NULL;
+
+	e = expr_number(1);
+	e->protos |= 1U << idx;
+	e->is_present = true;
+	return e;
+}
+
+struct expr *expr_proto(char *name)
+{
+	struct proto_field *field = proto_field_lookup(name);
+	struct in6_addr addr6;
+	struct in_addr addr;
+	struct expr *e;
+	int idx;
+
+	if (!field) {
+		if (proto_lookup(name))
+			return expr_present(proto_lookup(name));
+		if (inet_pton(AF_INET, name, &addr) == 1)
+			return expr_number(ntohl(addr.s_addr));
+		if (inet_pton(AF_INET6, name, &addr6) == 1)
+			return expr_wide_addr(&addr6);
+
+		fprintf(stderr, "error: unknown field '%s'\n", name);
+		return NULL;
+	}
+
+	idx = proto_index(field->proto);
+	if (idx < 0)
+		return NULL;
+
+	/* loaded by words when compared */
+	if (field->len > 4) {
+		e = expr_alloc();
+		e->reg = -1;
+		e->is_wide = true;
+		e->wide_field = field;
+	} else {
+		e = expr_field(field);
+	}
+
+	if (e)
+		e->protos |= 1U << idx;
+	return e;
+}
+
+struct expr *expr_proto_offset(char *name, struct expr *e)
+{
+	struct proto *proto = proto_lookup(name);
+	struct hdr_offset off;
+	int idx;
+
+	if (!proto) {
+		fprintf(stderr, "error: unknown protocol '%s'\n", name);
+		return NULL;
+	}
+	if (!expr_wide_check(e, NULL))
+		return NULL;
+
+	idx = proto_index(proto);
+	if (idx < 0 || proto_hdr_offset(proto, &off))
+		return NULL;
+	e->protos |= 1U << idx;
+
+	if (off.reg >= 0) {
+		instr_insert(e->instrs, instr_load_mem_a(e->reg));
+		instr_insert(e->instrs, instr_load_mem_x(off.reg));
+		instr_insert(e->instrs, instr_alu_x_a(BPF_ADD));
+		instr_insert(e->instrs, instr_store_a_mem(e->reg));
+	}
+
+	return expr_load_ind(e, off.offset, 1);
+}
+
+/* blocks reachable from the root, each one after all its predecessors */
+static int blocks_order(struct block *root, struct block **order)
+{
+	struct block **stack;
+	int depth = 0;
+	int count = 0;
+
+	stack = xmalloc(sizeof(struct block *) * block_count);
+	stack[depth++] = root;
+	root->is_reached = true;
+
+	while (depth) {
+		struct block *blk = stack[depth - 1];
+		struct block *jt = blk->jmp_true.target;
+		struct block *jf = blk->jmp_false.target;
+
+		if (jt && !jt->is_reached) {
+			jt->is_reached = true;
+			stack[depth++] = jt;
+			continue;
+		}
+		if (jf && !jf->is_reached) {
+			jf->is_reached = true;
+			stack[depth++] = jf;
+			continue;
+		}
+
+		order[count++] = blk;
+		depth--;
+	}
+
+	xfree(stack);
+	return count;
+}
+
+/* outcome of the guard if it follows from the known ones, -1 if it does not */
+static int guard_outcome(int guard, uint64_t known, uint64_t val)
+{
+	struct guard *g = &guards[guard];
+	int i;
+
+	if (known & (1ULL << guard))
+		return !!(val & (1ULL << guard));
+
+	if (g->type != GUARD_NEXT)
+		return -1;
+
+	/* the demux field tells one upper protocol only */
+	for (i = 0; i < guards_count; i++) {
+		if (!(known & val & (1ULL << i)) || guards[i].type != GUARD_NEXT)
+			continue;
+
+		if (guards[i].proto->demux == g->proto->demux &&
+				guards[i].proto->lower == g->proto->lower &&
+				guards[i].proto->id != g->proto->id)
+			return 0;
+	}
+
+	return -1;
+}
+
+static void guard_jmp_thread(struct block *blk, struct jmp_node *jmp,
+		bool is_true)
+{
+	int outcome;
+
+	uint64_t known = blk->guards_known;
+	uint64_t val = blk->guards_true;
+	struct block *target = jmp->target;
+
+	if (!target)
+		return;
+
+	if (blk->guard) {
+		known |= 1ULL << (blk->guard - 1);
+		if (is_true)
+			val |= 1ULL << (blk->guard - 1);
+	}
+
+	/* skip the guards with known outcome */
+	while (target->guard) {
+		outcome = guard_outcome(target->guard - 1, known, val);
+		if (outcome < 0)
+			break;
+
+		if (outcome)
+			target = target->jmp_true.target;
+		else
+			target = target->jmp_false.target;
+	}
+	jmp->target = target;
+
+	if (!target->is_reached) {
+		target->is_reached = true;
+		target->guards_known = known;
+		target->guards_true = val;
+	} else {
+		target->guards_known &= known & ~(target->guards_true ^ val);
+		target->guards_true &= target->guards_known;
+	}
+}
+
+/*
+ * Guards are repeated by every test which needs them, so each guard whose
+ * outcome is already known on all paths to it is jumped over, and any
+ * guard is tested at most once on a path.
+ */
+static void guards_thread(struct block *root)
+{
+	struct block **order;
+	struct block *blk, *tmp;
+	int count, i;
+
+	if (!guards_count)
+		return;
+
+	order = xmalloc(sizeof(struct block *) * block_count);
+
+	list_for_each_entry(blk, &blocks, list)
+		blk->is_reached = false;
+	count = blocks_order(root, order);
+
+	list_for_each_entry(blk, &blocks, list)
+		blk->is_reached = false;
+	root->is_reached = true;
+
+	for (i = count - 1; i >= 0; i--) {
+		blk = order[i];
+		if (!blk->is_reached)
+			continue;
+
+		guard_jmp_thread(blk, &blk->jmp_true, true);
+		guard_jmp_thread(blk, &blk->jmp_false, false);
+	}
+
+	/* the guards jumped over by all paths are gone */
+	list_for_each_entry_safe(blk, tmp, &blocks, list) {
+		if (blk->is_reached || blk == drop_block)
+			continue;
+		if (blk == shard_block)
+			shard_block = NULL;
+
+		instr_count -= instr_count_calc(blk->instrs);
+		instr_count -= blk->jmp_instr ? 1 : 0;
+		block_count--;
+
+		list_del(&blk->list);
+		block_free(blk);
+	}
+
+	xfree(order);
+}
+
+static bool instrs_mem_read(struct instr *list, int reg)
+{
+	struct instr *ins;
+
+	list_for_each_entry(ins, &list->list, list) {
+		if ((ins->code == (BPF_LD | BPF_MEM) ||
+				ins->code == (BPF_LDX | BPF_MEM)) && ins->k == reg)
+			return true;
+	}
+
+	return false;
+}
+
+/* A ^= A >> 16, keeps the high bits in the low ones used by mod */
+static void instr_hash_fold(struct instr *list)
+{
+	instr_insert(list, instr_tax());
+	instr_insert(list, instr_alu_k_a(BPF_RSH, 16));
+	instr_insert(list, instr_alu_x_a(BPF_XOR));
+}
+
+/* the furthest end of the key fields at the same offset register */
+static int shard_end_add(struct hdr_offset *ends, int count,
+		struct hdr_offset *off, int len)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (ends[i].reg != off->reg)
+			continue;
+
+		if (off->offset + len > ends[i].offset)
+			ends[i].offset = off->offset + len;
+		return count;
+	}
+
+	ends[count].reg = off->reg;
+	ends[count].offset = off->offset + len;
+	return count + 1;
+}
+
+/* end of the packet bytes read at a fixed offset by the blocks after first */
+static int blocks_abs_end(struct block *first)
+{
+	struct block *blk = first;
+	struct instr *ins;
+	int end = 0;
+
+	list_for_each_entry_continue(blk, &blocks, list) {
+		list_for_each_entry(ins, &blk->instrs->list, list) {
+			int len = 0;
+
+			if (BPF_CLASS(ins->code) == BPF_LD &&
+					BPF_MODE(ins->code) == BPF_ABS)
+				len = bpf_to_size(ins->code);
+			else if (ins->code == (BPF_LDX | BPF_B | BPF_MSH))
+				len = 1;
+
+			/* ancillary data is not in the packet */
+			if (len && (int32_t)ins->k >= 0 &&
+					(int)ins->k + len > end)
+				end = ins->k + len;
+		}
+	}
+
+	return end;
+}
+
+/* goes to next if the packet has the bytes up to the end, else to short */
+static struct block *shard_len_build(struct hdr_offset *end,
+		struct block *next, struct block *short_blk)
+{
+	struct block *blk = block_alloc();
+	struct instr *len = instr_alloc(BPF_LD | BPF_W | BPF_LEN, 0, 0, 0);
+
+	if (end->reg >= 0) {
+		instr_insert(blk->instrs, instr_load_mem_a(end->reg));
+		instr_insert(blk->instrs, instr_alu_k_a(BPF_ADD, end->offset));
+		instr_insert(blk->instrs, instr_tax());
+		instr_insert(blk->instrs, len);
+		blk->jmp_instr = instr_alloc(BPF_JMP | BPF_JGE | BPF_X, 0, 0, 0);
+	} else {
+		instr_insert(blk->instrs, len);
+		blk->jmp_instr = instr_alloc(BPF_JMP | BPF_JGE | BPF_K, 0, 0,
+				end->offset);
+	}
+
+	blk->jmp_true.target = next;
+	blk->jmp_false.target = short_blk;
+	return blk;
+}
+
+/*
+ * Key fields are XORed, so swapping source and destination gives the same
+ * hash, and mixed unless it is a single (hash like) field. Fields are read
+ * without guards, a packet too short for them (or for the lengths of their
+ * headers) has the hash 0, so each packet goes to exactly one shard.
+ */
+static struct block *shard_block_build(void)
+{
+	char *key = xmalloc(strlen(shard_key) + 1);
+	struct hdr_offset *ends = xmalloc(sizeof(*ends) *
+			(strlen(shard_key) + 1));
+	struct block *blk, *hash_blk, *short_blk, *root, *last;
+	struct expr *hash = NULL;
+	struct hdr_offset fixed;
+	int ends_count = 0;
+	int fields = 0;
+	char *name;
+	int i;
+
+	strcpy(key, shard_key);
+
+	for (name = strtok(key, ","); name; name = strtok(NULL, ",")) {
+		struct proto_field *field = proto_field_lookup(name);
+		struct hdr_offset off;
+		struct expr *e;
+
+		if (!field) {
+			fprintf(stderr, "error: unknown shard key field '%s'\n",
+					name);
+			goto err;
+		}
+
+		if (field_offset(field, &off))
+			goto err;
+		/* ancillary data is not in the packet */
+		if (off.reg >= 0 || off.offset >= 0)
+			ends_count = shard_end_add(ends, ends_count, &off,
+					field->len);
+
+		e = expr_field(field);
+		if (!e)
+			goto err;
+
+		hash = hash ? expr_build(OP_BXOR, hash, e) : e;
+		fields++;
+	}
+
+	if (!hash) {
+		fprintf(stderr, "error: empty shard key\n");
+		goto err;
+	}
+
+	/* patched for each shard */
+	blk = block_alloc();
+	blk->jmp_instr = instr_alloc(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 0);
+	branch_lists_init(blk, false);
+
+	hash_blk = build_jmp(blk);
+	instr_join(hash_blk->instrs, hash->instrs);
+	instr_insert(hash_blk->instrs, instr_load_mem_a(hash->reg));
+
+	if (fields > 1) {
+		instr_hash_fold(hash_blk->instrs);
+		instr_insert(hash_blk->instrs,
+				instr_alu_k_a(BPF_MUL, 0x45d9f3b));
+		instr_hash_fold(hash_blk->instrs);
+	}
+
+	if (shard_count & (shard_count - 1))
+		instr_insert(hash_blk->instrs,
+				instr_alu_k_a(BPF_MOD, shard_count));
+	else
+		instr_insert(hash_blk->instrs,
+				instr_alu_k_a(BPF_AND, shard_count - 1));
+
+	short_blk = build_jmp(blk);
+	instr_insert(short_blk->instrs, instr_val_load(0));
+
+	root = hash_blk;
+	for (i = ends_count - 1; i >= 0; i--) {
+		if (ends[i].reg >= 0)
+			root = shard_len_build(&ends[i], root, short_blk);
+	}
+
+	/* lengths the key needs, zero without guards */
+	last = list_last_entry(&blocks, struct block, list);
+	for (i = hdr_slots_count - 1; i >= 0; i--) {
+		if (hdr_slot_is_len(&hdr_slots[i]) &&
+				instrs_mem_read(hash_blk->instrs,
+					hdr_slots[i].reg))
+			root = hdr_var_build(&hdr_slots[i], root);
+	}
+
+	/* bytes at a fixed offset, read by the keys and the lengths */
+	fixed.reg = -1;
+	fixed.offset = blocks_abs_end(last);
+	for (i = 0; i < ends_count; i++) {
+		if (ends[i].reg < 0 && ends[i].offset > fixed.offset)
+			fixed.offset = ends[i].offset;
+	}
+	if (fixed.offset)
+		root = shard_len_build(&fixed, root, short_blk);
+	blk->root = root;
+
+	reg_put(hash->reg);
+	expr_free(hash);
+	xfree(ends);
+	xfree(key);
+	return blk;
+err:
+	if (hash) {
+		reg_put(hash->reg);
+		expr_free(hash);
+	}
+	xfree(ends);
+	xfree(key);
+	return NULL;
+}
+
+#define TESTS_HTABLE_SIZE	256
+
+struct test_entry {
+	struct hentry hlist;
+	struct block *blk;
+	int guard;
+};
+
+static bool block_is_test(struct block *blk)
+{
+	struct instr *jmp = blk->jmp_instr;
+
+	return !blk->guard && blk != shard_block && jmp &&
+		BPF_CLASS(jmp->code) == BPF_JMP && BPF_OP(jmp->code) != BPF_JA;
+}
+
+static unsigned long block_test_hash(struct block *blk)
+{
+	unsigned long hash = blk->jmp_instr->code * 31 + blk->jmp_instr->k;
+	struct instr *ins;
+
+	list_for_each_entry(ins, &blk->instrs->list, list)
+		hash = (hash ^ ins->code ^ ((unsigned long)ins->k << 16)) *
+			0x100000001b3UL;
+
+	return hash ^ (hash >> 29);
+}
+
+static bool test_entry_eq(struct hentry *entry, const void *key)
+{
+	struct block *blk = container_of(entry, struct test_entry, hlist)->blk;
+	const struct block *other = key;
+	struct list_head *a = blk->instrs->list.next;
+	struct list_head *b = other->instrs->list.next;
+
+	if (blk->jmp_instr->code != other->jmp_instr->code ||
+			blk->jmp_instr->k != other->jmp_instr->k)
+		return false;
+
+	for (; a != &blk->instrs->list && b != &other->instrs->list;
+			a = a->next, b = b->next) {
+		struct instr *x = container_of(a, struct instr, list);
+		struct instr *y = container_of(b, struct instr, list);
+
+		if (x->code != y->code || x->jt != y->jt || x->jf != y->jf ||
+				x->k != y->k)
+			return false;
+	}
+
+	return a == &blk->instrs->list && b == &other->instrs->list;
+}
+
+static int test_guard_get(void)
+{
+	if (guards_count == GUARDS_MAX)
+		return -1;
+
+	guards[guards_count].proto = NULL;
+	guards[guards_count].type = GUARD_TEST;
+	return guards_count++;
+}
+
+/*
+ * The filter tests are pure functions of the packet (and of the header
+ * offsets computed before them), so a test repeated by the filter (as the
+ * rules often do) becomes a guard, and it is threaded like the protocol
+ * ones. It is done before the header walks are built, as their unrolled
+ * steps look the same but read M[] they change.
+ */
+static void tests_share(void)
+{
+	struct test_entry *entries;
+	struct htable *tests;
+	struct block *blk;
+	int count = 0;
+
+	entries = xmalloc(sizeof(struct test_entry) * block_count);
+	tests = htable_alloc(TESTS_HTABLE_SIZE, test_entry_eq);
+
+	list_for_each_entry(blk, &blocks, list) {
+		unsigned long hash;
+		struct test_entry *te;
+		struct hentry *entry;
+
+		if (!block_is_test(blk))
+			continue;
+
+		hash = block_test_hash(blk);
+		entry = htable_find(tests, hash, blk);
+		if (!entry) {
+			te = &entries[count++];
+			te->blk = blk;
+			te->guard = -1;
+			htable_insert(tests, &te->hlist, hash);
+			continue;
+		}
+
+		te = container_of(entry, struct test_entry, hlist);
+		if (te->guard < 0)
+			te->guard = test_guard_get();
+		if (te->guard < 0)
+			continue;
+
+		te->blk->guard = te->guard + 1;
+		blk->guard = te->guard + 1;
+	}
+
+	htable_free(tests);
+	xfree(entries);
+}
+
+/*
+ * Slots only read by rules which are never reached (after one which holds
+ * for any packet) are not computed. A slot depends on the ones before it
+ * only, so the slots after the last one read are dropped.
+ */
+static void hdr_slots_trim(struct block *root)
+{
+	struct block **order;
+	struct block *blk;
+	int count, i, j;
+	int used = 0;
+
+	order = xmalloc(sizeof(struct block *) * block_count);
+
+	list_for_each_entry(blk, &blocks, list)
+		blk->is_reached = false;
+	count = blocks_order(root, order);
+
+	for (i = 0; i < count; i++) {
+		for (j = hdr_slots_count - 1; j >= used; j--) {
+			struct hdr_slot *slot = &hdr_slots[j];
+
+			if (instrs_mem_read(order[i]->instrs, slot->reg) ||
+					(slot->next_reg >= 0 &&
+					 instrs_mem_read(order[i]->instrs,
+						 slot->next_reg))) {
+				used = j + 1;
+				break;
+			}
+		}
+	}
+
+	hdr_slots_count = used;
+	xfree(order);
+}
+
+static void program_finish(struct block *blk)
+{
+	root_block = blk->root;
+	if (!root_block)
+		printf("parse_finish: no root\n");
+
+	tests_share();
+	hdr_slots_trim(root_block);
+
+	/* walks test the guards too, so they are threaded as well */
+	root_block = hdr_slots_build(root_block);
+	guards_thread(root_block);
+}
+
+static void union_add(struct block *blk)
+{
+	if (union_match_index) {
+		rule_build(blk, union_idx + 1);
+	} else {
+		if (!union_accept)
+			union_accept = build_accept();
+		backpatch(&blk->true_list, union_accept);
+	}
+
+	union_blk = union_blk ? rules_merge(union_blk, blk) : blk;
+}
+
+void parse_finish(struct block *blk)
+{
+	if (!blk)
+		printf("parse_finish: input block is NULL\n");
+
+	if (union_count) {
+		union_add(blk);
+		return;
+	}
+
+	drop_block = build_drop();
+
+	if (shard_count) {
+		shard_block = shard_block_build();
+		if (shard_block)
+			blk = branch_merge(OP_LAND, blk, shard_block);
+	}
+
+	backpatch(&blk->true_list, build_accept());
+	backpatch(&blk->false_list, drop_block);
+
+	program_finish(blk);
+}
+
+/* the rule returns its value if it holds, the next rule is tried if not */
+struct block *rule_build(struct block *blk, uint32_t retval)
+{
+	backpatch(&blk->true_list, build_return(retval));
+	return blk;
+}
+
+/* the rule which holds for any packet */
+struct block *rule_always(uint32_t retval)
+{
+	return build_return(retval);
+}
+
+/*
+ * The rule returns the value of the expression (ret A), if the headers it
+ * reads are there and blk (if any) holds.
+ */
+struct block *rule_return(struct block *blk, struct expr *e)
+{
+	uint32_t mask = e->protos;
+	struct block *guards;
+	struct block *ret;
+
+	if (!expr_wide_check(e, NULL))
+		return NULL;
+
+	ret = block_alloc();
+	instr_join(ret->instrs, e->instrs);
+	instr_insert(ret->instrs, instr_load_mem_a(e->reg));
+	ret->jmp_instr = instr_alloc(BPF_RET | BPF_A, 0, 0, 0);
+
+	reg_put(e->reg);
+	expr_free(e);
+
+	guards = guards_chain_build(mask);
+	if (guards) {
+		backpatch(&guards->true_list, ret->root);
+		ret = guards;
+	}
+
+	if (!blk)
+		return ret;
+
+	backpatch(&blk->true_list, ret->root);
+	if (guards)
+		jmp_list_join(&blk->false_list, &ret->false_list);
+
+	ret->false_list = blk->false_list;
+	ret->root = blk->root;
+	return ret;
+}
+
+struct block *rules_merge(struct block *rules, struct block *rule)
+{
+	backpatch(&rules->false_list, rule->root);
+
+	rule->root = rules->root;
+	return rule;
+}
+
+/* the rules before it always return, the rule is left out */
+struct block *rules_add(struct block *rules, struct block *rule)
+{
+	struct src_loc *src = &src_cur;
+
+	if (rules->false_list.head)
+		return rules_merge(rules, rule);
+
+	if (src->text)
+		fprintf(stderr, "warning: rule is never reached, in '%.*s'\n",
+				src->last - src->first, src->text + src->first);
+	else
+		fprintf(stderr, "warning: rule is never reached, at line %d\n",
+				src->line);
+	return rules;
+}
+
+/* the packet is dropped if none of the rules holds */
+int parse_rules_finish(struct block *rules)
+{
+	/* the rules keep their own return values */
+	if (union_count) {
+		union_blk = union_blk ? rules_merge(union_blk, rules) : rules;
+		return 0;
+	}
+
+	if (shard_count) {
+		fprintf(stderr, "error: rules can not be sharded\n");
+		return -1;
+	}
+	if (is_fragment) {
+		fprintf(stderr, "error: rules can not be clauses\n");
+		return -1;
+	}
+
+	drop_block = build_drop();
+	backpatch(&rules->false_list, drop_block);
+
+	program_finish(rules);
+	return 0;
+}
+
+/* conditional jumps have 8 bit offsets, longer ones go through a ja */
+static int jmp_trampoline(struct block *target)
+{
+	struct sock_filter *code = --code_end;
+	int offset = code - code_start;
+
+	code->code = BPF_JMP | BPF_JA;
+	code->jt = code->jf = 0;
+	code->k = target->offset - (offset + 1);
+
+	return offset;
+}
+
+static int jmp_target_offset(struct block *target)
+{
+	/* keep room for the other trampoline which may follow the block */
+	if (target->offset - (code_end - code_start) > JMP_OFFSET_MAX - 1)
+		return jmp_trampoline(target);
+
+	return target->offset;
+}
+
+static bool instr_is_ja(struct instr *ins)
+{
+	return ins->code == (BPF_JMP | BPF_JA);
+}
+
+static void block_emit(struct block *blk)
+{
+	struct block *jt = blk->jmp_true.target;
+	struct block *jf = blk->jmp_false.target;
+	struct instr *jmp = blk->jmp_instr;
+	int jt_offset = -1, jf_offset = -1;
+	struct sock_filter *tramp_end = code_end;
+	struct sock_filter *code;
+	struct list_head *pos;
+	int ins_count;
+	int i;
+
+	if (jmp && instr_is_ja(jmp)) {
+		/* falls through to the target placed right after */
+		if (jt->offset == code_end - code_start)
+			jmp = NULL;
+	} else if (jmp) {
+		jf_offset = jf ? jmp_target_offset(jf) : -1;
+		jt_offset = jt ? jmp_target_offset(jt) : -1;
+	}
+
+	ins_count = instr_count_calc(blk->instrs);
+	ins_count += jmp ? 1 : 0;
+
+	code = code_end -= ins_count;
+	blk->offset = code - code_start;
+
+	/* with the trampolines of its jump placed right after it */
+	for (i = blk->offset; i < tramp_end - code_start; i++)
+		code_blocks[i] = blk;
+
+	list_for_each(pos, &blk->instrs->list) {
+		struct instr *ins = container_of(pos, struct instr, list);
+
+		if (ins->is_optimized)
+			continue;
+
+		code->code = ins->code;
+		code->jt = ins->jt;
+		code->jf = ins->jf;
+		code->k = ins->k;
+		code++;
+	}
+
+	if (!jmp)
+		return;
+
+	code->code = jmp->code;
+
+	if (instr_is_ja(jmp)) {
+		code->jt = code->jf = 0;
+		code->k = jt->offset - (blk->offset + ins_count);
+		return;
+	}
+
+	if (jt)
+		code->jt = jt_offset - (blk->offset + ins_count);
+	else
+		code->jt = jmp->jt;
+
+	if (jf)
+		code->jf = jf_offset - (blk->offset + ins_count);
+	else
+		code->jf = jmp->jf;
+
+	code->k = jmp->k;
+}
+
+/*
+ * Blocks are placed backwards from the end of the code after all their
+ * jump targets, walking the graph with an explicit stack as it may be
+ * as deep as the number of terms in the filter.
+ */
+static void compile_block(struct block *root)
+{
+	struct block **stack;
+	struct block *blk;
+	int depth = 0;
+
+	if (!root || root->offset >= 0)
+		return;
+
+	stack = xmalloc(sizeof(struct block *) * block_count);
+	stack[depth++] = root;
+
+	while (depth) {
+		struct block *jt, *jf;
+
+		blk = stack[depth - 1];
+		jt = blk->jmp_true.target;
+		jf = blk->jmp_false.target;
+
+		if (jf && jf->offset < 0) {
+			stack[depth++] = jf;
+			continue;
+		}
+		if (jt && jt->offset < 0) {
+			stack[depth++] = jt;
+			continue;
+		}
+
+		block_emit(blk);
+		depth--;
+	}
+
+	xfree(stack);
+}
+
+/* M[] registers read where the kernel does not see a store before */
+static uint32_t code_mem_unset(struct sock_filter *f, int count)
+{
+	uint32_t *masks = xmalloc(sizeof(*masks) * count);
+	uint32_t memvalid = 0;
+	uint32_t unset = 0;
+	int pc;
+
+	for (pc = 0; pc < count; pc++)
+		masks[pc] = ~0;
+
+	for (pc = 0; pc < count; pc++) {
+		uint16_t code = f[pc].code;
+
+		memvalid &= masks[pc];
+
+		switch (code) {
+		case BPF_ST:
+		case BPF_STX:
+			memvalid |= 1U << f[pc].k;
+			break;
+		case BPF_LD | BPF_MEM:
+		case BPF_LDX | BPF_MEM:
+			unset |= ~memvalid & (1U << f[pc].k);
+			break;
+		case BPF_JMP | BPF_JA:
+			masks[pc + 1 + f[pc].k] &= memvalid;
+			memvalid = ~0;
+			break;
+		default:
+			if (BPF_CLASS(code) != BPF_JMP)
+				break;
+			masks[pc + 1 + f[pc].jt] &= memvalid;
+			masks[pc + 1 + f[pc].jf] &= memvalid;
+			memvalid = ~0;
+		}
+	}
+
+	xfree(masks);
+	return unset;
+}
+
+/*
+ * The kernel follows the stores along the code rather than the paths, the
+ * code placed after a ret starts with what was stored before it. A length
+ * stored by the guards of its header may look unset to it then, so it is
+ * stored at the program start (A is 0 there), the paths reading it store
+ * the length anyway.
+ */
+static void hdr_lens_init(int count)
+{
+	uint32_t unset = code_mem_unset(code_end, count);
+	int i;
+
+	for (i = 0; i < hdr_slots_count; i++) {
+		struct hdr_slot *slot = &hdr_slots[i];
+
+		if (!hdr_slot_is_len(slot) || !(unset & (1U << slot->reg)))
+			continue;
+
+		code_end--;
+		code_end->code = BPF_ST;
+		code_end->jt = 0;
+		code_end->jf = 0;
+		code_end->k = slot->reg;
+		code_blocks[code_end - code_start] = NULL;
+	}
+}
+
+static void compile_verify_report(int idx, const char *msg, void *arg)
+{
+	struct block **blocks = arg;
+	struct block *blk = idx >= 0 ? blocks[idx] : NULL;
+	struct src_loc *src = blk ? &blk->src : NULL;
+
+	if (idx < 0)
+		fprintf(stderr, "error: %s\n", msg);
+	else if (!src || !src->line)
+		fprintf(stderr, "error: L%d: %s\n", idx, msg);
+	else if (src->text)
+		fprintf(stderr, "error: L%d: %s, in '%.*s'\n", idx, msg,
+				src->last - src->first, src->text + src->first);
+	else
+		fprintf(stderr, "error: L%d: %s, at line %d\n", idx, msg,
+				src->line);
+}
+
+/* the program is checked as the kernel would before it is attached */
+void compile_verify_set(bool is_on)
+{
+	do_verify = is_on;
+}
+
+static void compiler_init(struct compiler *comp)
+{
+	memset(comp, 0, sizeof(*comp));
+	INIT_LIST_HEAD(&comp->blocks);
+
+	memset(regs, 0, sizeof(regs));
+	INIT_LIST_HEAD(&blocks);
+	root_block = NULL;
+	drop_block = NULL;
+	instr_count = 0;
+	block_count = 0;
+	hdr_slots_count = 0;
+	protos_count = 0;
+	guards_count = 0;
+	shard_block = NULL;
+	shard_jmp = -1;
+}
+
+static int compile(int (*parse)(char *), char *arg,
+		struct sock_filter **filter, bool do_optimize, bool drop_last,
+		struct compiler_stats *stats)
+{
+	struct compiler comp;
+	uint64_t start;
+	int code_len;
+	int ret, i;
+
+	compiler_init(&comp);
+	stats_begin(stats);
+
+	start = stats_timer_start();
+	ret = parse(arg);
+	stats_timer_stop(STAGE_PARSE, start);
+
+	list_join_tail_init(&blocks, &comp.blocks);
+
+	if (shard_count && !shard_block && root_block)
+		ret = -1;
+
+	if (ret || !root_block || instr_count == 0) {
+		instr_count = ret ? -1 : 0;
+		goto out;
+	}
 
 	comp.instr_count = instr_count;
 	comp.block_count = block_count;
 	comp.root_block = root_block;
-	list_join_tail(&blocks, &comp.blocks);
+	for (i = 0; i < hdr_slots_count; i++) {
+		comp.hdr_regs |= 1 << hdr_slots[i].reg;
+		if (hdr_slots[i].next_reg >= 0)
+			comp.hdr_regs |= 1 << hdr_slots[i].next_reg;
+	}
+
+	if (stats) {
+		stats->instrs_generated = instr_count;
+		stats->block_count = block_count;
+	}
 
-	if (do_optimize)
-		instr_count = optimize(&comp);
+	if (do_optimize) {
+		start = stats_timer_start();
+		comp.instr_count = optimize(&comp);
+		instr_count = peephole(&comp);
+		stats_timer_stop(STAGE_OPTIMIZE, start);
+	}
 
-	code_start = xmalloc(sizeof(struct sock_filter) * instr_count);
-	code_end = code_start + instr_count;
+	start = stats_timer_start();
+	/* each block may need up to two jump trampolines */
+	code_len = instr_count + 2 * block_count + hdr_slots_count;
+	code_start = xmalloc(sizeof(struct sock_filter) * code_len);
+	code_end = code_start + code_len;
+	code_blocks = xmalloc(sizeof(struct block *) * code_len);
 
+	/* so the drop exit can fall through to the code placed next */
+	if (drop_last)
+		compile_block(drop_block);
 	compile_block(root_block);
+	hdr_lens_init(code_start + code_len - code_end);
+
+	if (shard_block && shard_block->offset >= 0)
+		shard_jmp = shard_block->offset - (code_end - code_start) +
+			instr_count_calc(shard_block->instrs);
+
+	/* the code is placed backwards, jumps are relative */
+	instr_count = code_start + code_len - code_end;
+	memmove(code_start, code_end, sizeof(struct sock_filter) * instr_count);
+	memmove(code_blocks, code_blocks + (code_end - code_start),
+			sizeof(struct block *) * instr_count);
+	stats_timer_stop(STAGE_EMIT, start);
+
+	ret = do_verify ? verify(code_start, instr_count,
+			compile_verify_report, code_blocks) : 0;
+	xfree(code_blocks);
+
+	if (ret) {
+		xfree(code_start);
+		instr_count = -1;
+		goto out;
+	}
 
 	*filter = code_start;
+out:
+	if (stats) {
+		/* codegen runs from the parser actions */
+		stats->stage_ns[STAGE_PARSE] -= stats->stage_ns[STAGE_CODEGEN];
+		stats->instrs_emitted = instr_count > 0 ? instr_count : 0;
+	}
+
+	blocks_free(&comp.blocks);
+	stats_end();
 	return instr_count;
 }
+
+int compile_filter(char *expr, struct sock_filter **filter, bool do_optimize,
+		struct compiler_stats *stats)
+{
+	return compile(parse_filter, expr, filter, do_optimize, false, stats);
+}
+
+/*
+ * Program for the shard is the returned one with jmp_idx compare patched
+ * to its index, the rest is shared by all the shards.
+ */
+int compile_filter_shard(char *expr, struct sock_filter **filter,
+		bool do_optimize, int count, char *key, int *jmp_idx)
+{
+	int ret;
+
+	shard_count = count;
+	shard_key = key;
+
+	ret = compile(parse_filter, expr, filter, do_optimize, false, NULL);
+	*jmp_idx = shard_jmp;
+
+	shard_count = 0;
+	shard_key = NULL;
+	return ret;
+}
+
+static int parse_union(char *arg)
+{
+	int count = union_count;
+	int ret;
+
+	union_blk = NULL;
+	union_accept = NULL;
+
+	for (union_idx = 0; union_idx < count; union_idx++) {
+		if (parse_filter(union_exprs[union_idx]))
+			return -1;
+	}
+
+	if (!union_blk)
+		return 0;
+
+	/* finish the merged program as a single list of rules */
+	union_count = 0;
+	ret = parse_rules_finish(union_blk);
+	union_count = count;
+	return ret;
+}
+
+/*
+ * One program which accepts the packet if any of the filters does (or
+ * returns the index + 1 of the first one which does). A test shared by
+ * the filters, like their protocol guards and a common first compare, is
+ * done once on a path, so the program branches like a trie of them.
+ */
+int compile_filter_union(char **exprs, int count, struct sock_filter **filter,
+		bool do_optimize, bool match_index, struct compiler_stats *stats)
+{
+	int ret;
+
+	union_exprs = exprs;
+	union_count = count;
+	union_match_index = match_index;
+
+	ret = compile(parse_union, NULL, filter, do_optimize, false, stats);
+
+	union_exprs = NULL;
+	union_count = 0;
+	return ret;
+}
+
+int compile_filter_file(char *path, struct sock_filter **filter,
+		bool do_optimize, struct compiler_stats *stats)
+{
+	return compile(parse_file, path, filter, do_optimize, false, stats);
+}
+
+int compile_fragment(char *expr, struct sock_filter **filter, bool do_optimize)
+{
+	int ret;
+
+	is_fragment = true;
+	ret = compile(parse_filter, expr, filter, do_optimize, true, NULL);
+	is_fragment = false;
+
+	return ret;
+}
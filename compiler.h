@@ -2,6 +2,7 @@
 #define __COMPILER_H__
 
 #include "list.h"
+#include "stats.h"
 
 #include <stdint.h>
 #include <stdbool.h>
@@ -26,6 +27,7 @@ typedef enum {
 	OP_ADD,
 	OP_MUL,
 	OP_DIV,
+	OP_MOD,
 	OP_BAND,
 	OP_BOR,
 	OP_BXOR,
@@ -50,17 +52,44 @@ struct instr {
 	uint32_t k;
 };
 
+struct proto_field;
+
 struct expr {
 	struct instr *instrs;
 	int reg;
+	/* protocols referenced, the expression needs their guards */
+	uint32_t protos;
+	/* protocol name, true if its header is there */
+	bool is_present;
+	/* literal number, its value is known while parsing */
+	bool is_number;
+	uint32_t number;
+	/* 128 bit field or address, can only be compared */
+	bool is_wide;
+	struct proto_field *wide_field;
+	uint32_t wide_addr[4];
 };
 
 struct jmp_node {
 	struct block *target;
+	/* next unresolved jump in the same true/false list */
+	struct jmp_node *next;
+};
+
+struct jmp_list {
+	struct jmp_node *head;
+	struct jmp_node *tail;
+};
+
+/* span of the filter text a block was built for, line 0 if none */
+struct src_loc {
+	const char *text;
+	int line;
+	int first;
+	int last;
 };
 
 struct block {
-	bool is_reversed;
 	struct list_head list;
 	int offset;
 	struct instr *jmp_instr;
@@ -68,7 +97,17 @@ struct block {
 	struct instr *instrs;
 	struct jmp_node jmp_true;
 	struct jmp_node jmp_false;
+	/* unresolved exits of the branch ending at this block */
+	struct jmp_list true_list;
+	struct jmp_list false_list;
 	int regs[REGS_MAX];
+	/* implicit protocol guard tested by the block (index + 1) */
+	int guard;
+	/* guard outcomes known on every path to the block */
+	bool is_reached;
+	uint64_t guards_known;
+	uint64_t guards_true;
+	struct src_loc src;
 };
 
 struct compiler {
@@ -76,18 +115,23 @@ struct compiler {
 	int block_count;
 	struct list_head blocks;
 	struct block *root_block;
+	/* M[] registers live across blocks */
+	uint32_t hdr_regs;
 };
 
 struct block *block_build(struct expr *e);
 struct block *branch_merge(oper_t op, struct block *l, struct block *r);
 struct block *branch_not(struct block *blk);
 struct block *branch_build(oper_t op, struct expr *l, struct expr *r);
+struct block *pattern_build(char *name, int offset, int len, oper_t op,
+		char *str);
 
 struct expr *expr_build(oper_t op, struct expr *l, struct expr *r);
 struct expr *expr_add(struct expr *l, struct expr *r);
 struct expr *expr_sub(struct expr *l, struct expr *r);
 struct expr *expr_mul(struct expr *l, struct expr *r);
 struct expr *expr_div(struct expr *l, struct expr *r);
+struct expr *expr_mod(struct expr *l, struct expr *r);
 struct expr *expr_and(struct expr *l, struct expr *r);
 struct expr *expr_or(struct expr *l, struct expr *r);
 struct expr *expr_xor(struct expr *l, struct expr *r);
@@ -98,9 +142,28 @@ struct expr *expr_number(unsigned int value);
 struct expr *expr_proto(char *name);
 struct expr *expr_proto_offset(char *name, struct expr *e);
 
-void parse_filter(char *expr);
+void src_text_set(const char *text);
+void src_loc_set(int line, int first, int last);
+
+int parse_filter(char *expr);
+int parse_file(char *path);
 
-int compile_filter(char *expr, struct sock_filter **f, bool do_optimize);
+int compile_filter(char *expr, struct sock_filter **f, bool do_optimize,
+		struct compiler_stats *stats);
+int compile_filter_union(char **exprs, int count, struct sock_filter **f,
+		bool do_optimize, bool match_index, struct compiler_stats *stats);
+int compile_filter_file(char *path, struct sock_filter **f, bool do_optimize,
+		struct compiler_stats *stats);
+int compile_fragment(char *expr, struct sock_filter **f, bool do_optimize);
+int compile_filter_shard(char *expr, struct sock_filter **f, bool do_optimize,
+		int count, char *key, int *jmp_idx);
+void compile_verify_set(bool is_on);
 void parse_finish(struct block *blk);
+struct block *rule_build(struct block *blk, uint32_t retval);
+struct block *rules_merge(struct block *rules, struct block *rule);
+struct block *rules_add(struct block *rules, struct block *rule);
+struct block *rule_always(uint32_t retval);
+struct block *rule_return(struct block *blk, struct expr *e);
+int parse_rules_finish(struct block *rules);
 
 #endif
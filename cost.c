@@ -0,0 +1,589 @@
+/*
+ * cost.c	path length of the emitted program
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * Authors:	Vadim Kochan <vadim4j@gmail.com>
+ */
+
+/*
+ * Jumps only go forward, so the number of instructions run from each one
+ * to a ret is known from the ones after it: the shortest and the longest
+ * path, and the average one with each branch taken half of the times.
+ * With a capture the program is run on its packets, which gives the
+ * average the traffic sees and how often each block runs. The capture has
+ * no socket metadata, the ancillary loads other than the protocol and the
+ * VLAN tag read 0.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <byteswap.h>
+
+#include "cost.h"
+#include "xmalloc.h"
+
+#define COST_HOT_MAX	5
+
+#define PCAP_MAGIC		0xa1b2c3d4
+#define PCAP_MAGIC_NS		0xa1b23c4d
+#define PCAP_LINKTYPE_ETHER	1
+#define PCAP_HDR_LEN		24
+#define PCAP_REC_LEN		16
+#define PCAP_SNAP_MAX		262144
+
+#define ETH_HLEN	14
+#define ETH_P_8021Q	0x8100
+#define ETH_P_8021AD	0x88a8
+#define VLAN_HLEN	4
+#define ARPHRD_ETHER	1
+
+struct cost_path {
+	int min;
+	int max;
+	/* with each branch taken half of the times */
+	double avg;
+	double count;
+};
+
+struct cost_block {
+	int start;
+	int len;
+	/* instructions of the block run per packet */
+	double weight;
+};
+
+struct cost_pkt {
+	uint8_t *data;
+	uint32_t len;
+	uint32_t wire_len;
+	uint16_t proto;
+	bool has_vlan;
+	uint16_t vlan_tci;
+};
+
+struct cost_capture {
+	uint64_t packets;
+	uint64_t accepted;
+	uint64_t executed;
+	int max;
+	uint64_t *hits;
+};
+
+/* next instructions of a jump or of the one before, false for a ret */
+static bool cost_next(struct sock_filter *f, int i, long *jt, long *jf)
+{
+	struct sock_filter *ins = &f[i];
+
+	if (BPF_CLASS(ins->code) == BPF_RET)
+		return false;
+
+	if (BPF_CLASS(ins->code) != BPF_JMP) {
+		*jt = *jf = i + 1;
+	} else if (BPF_OP(ins->code) == BPF_JA) {
+		*jt = *jf = i + 1 + (long)ins->k;
+	} else {
+		*jt = i + 1 + ins->jt;
+		*jf = i + 1 + ins->jf;
+	}
+
+	return true;
+}
+
+static int cost_paths(struct sock_filter *f, int count, struct cost_path *p)
+{
+	long jt, jf;
+	int i;
+
+	for (i = count - 1; i >= 0; i--) {
+		struct cost_path *c = &p[i];
+
+		if (!cost_next(f, i, &jt, &jf)) {
+			c->min = c->max = 1;
+			c->avg = c->count = 1;
+			continue;
+		}
+
+		if (jt >= count || jf >= count) {
+			fprintf(stderr, "error: L%d goes past the program\n", i);
+			return -1;
+		}
+
+		c->min = 1 + (p[jt].min < p[jf].min ? p[jt].min : p[jf].min);
+		c->max = 1 + (p[jt].max > p[jf].max ? p[jt].max : p[jf].max);
+		c->avg = 1 + (p[jt].avg + p[jf].avg) / 2;
+		c->count = jt == jf ? p[jt].count : p[jt].count + p[jf].count;
+	}
+
+	return 0;
+}
+
+/* part of the packets which run each instruction, branches taken evenly */
+static void cost_reach(struct sock_filter *f, int count, double *reach)
+{
+	long jt, jf;
+	int i;
+
+	memset(reach, 0, sizeof(double) * count);
+	reach[0] = 1;
+
+	for (i = 0; i < count; i++) {
+		if (!cost_next(f, i, &jt, &jf))
+			continue;
+
+		reach[jt] += reach[i] / 2;
+		reach[jf] += reach[i] / 2;
+	}
+}
+
+static int cost_blocks(struct sock_filter *f, int count,
+		struct cost_block *blocks)
+{
+	bool *is_leader = xmalloc(count + 1);
+	int blocks_count = 0;
+	long jt, jf;
+	int i;
+
+	memset(is_leader, 0, count + 1);
+	is_leader[0] = true;
+
+	for (i = 0; i < count; i++) {
+		if (!cost_next(f, i, &jt, &jf)) {
+			is_leader[i + 1] = true;
+		} else if (BPF_CLASS(f[i].code) == BPF_JMP) {
+			is_leader[jt] = is_leader[jf] = true;
+			is_leader[i + 1] = true;
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		if (is_leader[i]) {
+			blocks[blocks_count].start = i;
+			blocks[blocks_count].len = 0;
+			blocks[blocks_count].weight = 0;
+			blocks_count++;
+		}
+
+		blocks[blocks_count - 1].len++;
+	}
+
+	xfree(is_leader);
+	return blocks_count;
+}
+
+static int cost_block_cmp(const void *a, const void *b)
+{
+	const struct cost_block *l = a;
+	const struct cost_block *r = b;
+
+	if (l->weight != r->weight)
+		return l->weight < r->weight ? 1 : -1;
+
+	return l->start - r->start;
+}
+
+static uint32_t cost_ancillary(struct cost_pkt *pkt, uint32_t off)
+{
+	switch (off) {
+	case SKF_AD_PROTOCOL:
+		return pkt->proto;
+	case SKF_AD_HATYPE:
+		return ARPHRD_ETHER;
+	case SKF_AD_VLAN_TAG:
+		return pkt->vlan_tci;
+	case SKF_AD_VLAN_TAG_PRESENT:
+		return pkt->has_vlan;
+	}
+
+	return 0;
+}
+
+static bool cost_load(struct cost_pkt *pkt, uint16_t code, uint32_t k,
+		uint32_t *v)
+{
+	uint32_t size = BPF_SIZE(code) == BPF_W ? 4 :
+		BPF_SIZE(code) == BPF_H ? 2 : 1;
+	uint32_t off = k;
+	uint32_t i;
+
+	if (k >= (uint32_t)SKF_AD_OFF) {
+		*v = cost_ancillary(pkt, k - SKF_AD_OFF);
+		return true;
+	}
+	if (k >= (uint32_t)SKF_NET_OFF)
+		off = k - SKF_NET_OFF + ETH_HLEN;
+	else if (k >= (uint32_t)SKF_LL_OFF)
+		off = k - SKF_LL_OFF;
+
+	if (off >= pkt->len || pkt->len - off < size)
+		return false;
+
+	*v = 0;
+	for (i = 0; i < size; i++)
+		*v = *v << 8 | pkt->data[off + i];
+
+	return true;
+}
+
+static uint32_t cost_alu(int op, uint32_t a, uint32_t v)
+{
+	switch (op) {
+	case BPF_ADD:
+		return a + v;
+	case BPF_SUB:
+		return a - v;
+	case BPF_MUL:
+		return a * v;
+	case BPF_DIV:
+		return a / v;
+	case BPF_MOD:
+		return a % v;
+	case BPF_AND:
+		return a & v;
+	case BPF_OR:
+		return a | v;
+	case BPF_XOR:
+		return a ^ v;
+	case BPF_LSH:
+		return v < 32 ? a << v : 0;
+	case BPF_RSH:
+		return v < 32 ? a >> v : 0;
+	case BPF_NEG:
+		return -a;
+	}
+
+	return a;
+}
+
+static bool cost_cond(int op, uint32_t a, uint32_t v)
+{
+	switch (op) {
+	case BPF_JEQ:
+		return a == v;
+	case BPF_JGT:
+		return a > v;
+	case BPF_JGE:
+		return a >= v;
+	case BPF_JSET:
+		return a & v;
+	}
+
+	return false;
+}
+
+/* the value the program returns, a failed load or division drops */
+static uint32_t cost_run(struct sock_filter *f, int count,
+		struct cost_pkt *pkt, uint64_t *hits, int *executed)
+{
+	uint32_t mem[BPF_MEMWORDS] = { 0 };
+	uint32_t a = 0, x = 0;
+	int pc;
+
+	*executed = 0;
+
+	for (pc = 0; pc < count; pc++) {
+		struct sock_filter *ins = &f[pc];
+		uint32_t v = BPF_SRC(ins->code) == BPF_X ? x : ins->k;
+
+		hits[pc]++;
+		(*executed)++;
+
+		switch (BPF_CLASS(ins->code)) {
+		case BPF_LD:
+			if (BPF_MODE(ins->code) == BPF_IMM)
+				a = ins->k;
+			else if (BPF_MODE(ins->code) == BPF_LEN)
+				a = pkt->wire_len;
+			else if (BPF_MODE(ins->code) == BPF_MEM)
+				a = mem[ins->k % BPF_MEMWORDS];
+			else if (!cost_load(pkt, ins->code,
+					BPF_MODE(ins->code) == BPF_IND ?
+					x + ins->k : ins->k, &a))
+				return 0;
+			break;
+		case BPF_LDX:
+			if (BPF_MODE(ins->code) == BPF_IMM) {
+				x = ins->k;
+			} else if (BPF_MODE(ins->code) == BPF_LEN) {
+				x = pkt->wire_len;
+			} else if (BPF_MODE(ins->code) == BPF_MEM) {
+				x = mem[ins->k % BPF_MEMWORDS];
+			} else {
+				if (!cost_load(pkt, BPF_B, ins->k, &x))
+					return 0;
+				x = 4 * (x & 0xf);
+			}
+			break;
+		case BPF_ST:
+			mem[ins->k % BPF_MEMWORDS] = a;
+			break;
+		case BPF_STX:
+			mem[ins->k % BPF_MEMWORDS] = x;
+			break;
+		case BPF_ALU:
+			if ((BPF_OP(ins->code) == BPF_DIV ||
+			     BPF_OP(ins->code) == BPF_MOD) && !v)
+				return 0;
+			a = cost_alu(BPF_OP(ins->code), a, v);
+			break;
+		case BPF_JMP:
+			if (BPF_OP(ins->code) == BPF_JA)
+				pc += ins->k;
+			else if (cost_cond(BPF_OP(ins->code), a, v))
+				pc += ins->jt;
+			else
+				pc += ins->jf;
+			break;
+		case BPF_RET:
+			return BPF_RVAL(ins->code) == BPF_A ? a : ins->k;
+		case BPF_MISC:
+			if (BPF_MISCOP(ins->code) == BPF_TAX)
+				x = a;
+			else
+				a = x;
+			break;
+		}
+	}
+
+	return 0;
+}
+
+/* the kernel moves the outer tag to the metadata the program reads */
+static bool cost_reads_vlan(struct sock_filter *f, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (BPF_CLASS(f[i].code) != BPF_LD ||
+				BPF_MODE(f[i].code) != BPF_ABS)
+			continue;
+
+		if (f[i].k == (uint32_t)(SKF_AD_OFF + SKF_AD_VLAN_TAG) ||
+				f[i].k == (uint32_t)(SKF_AD_OFF +
+					SKF_AD_VLAN_TAG_PRESENT))
+			return true;
+	}
+
+	return false;
+}
+
+static void cost_pkt_decode(struct cost_pkt *pkt, bool vlan_untag)
+{
+	uint8_t *d = pkt->data;
+
+	pkt->has_vlan = false;
+	pkt->vlan_tci = 0;
+	pkt->proto = 0;
+
+	if (pkt->len < ETH_HLEN)
+		return;
+
+	pkt->proto = d[12] << 8 | d[13];
+
+	if (!vlan_untag || pkt->len < ETH_HLEN + VLAN_HLEN ||
+			(pkt->proto != ETH_P_8021Q && pkt->proto != ETH_P_8021AD))
+		return;
+
+	pkt->has_vlan = true;
+	pkt->vlan_tci = d[14] << 8 | d[15];
+	memmove(d + 12, d + 12 + VLAN_HLEN, pkt->len - 12 - VLAN_HLEN);
+	pkt->len -= VLAN_HLEN;
+	pkt->wire_len -= VLAN_HLEN;
+	pkt->proto = d[12] << 8 | d[13];
+}
+
+static uint32_t pcap_u32(uint8_t *p, bool is_swapped)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return is_swapped ? bswap_32(v) : v;
+}
+
+static FILE *pcap_open(char *path, bool *is_swapped)
+{
+	uint8_t hdr[PCAP_HDR_LEN];
+	uint32_t magic;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		fprintf(stderr, "error: can't open '%s'\n", path);
+		return NULL;
+	}
+
+	if (fread(hdr, sizeof(hdr), 1, fp) != 1) {
+		fprintf(stderr, "error: '%s' is not a pcap file\n", path);
+		goto err;
+	}
+
+	magic = pcap_u32(hdr, false);
+	*is_swapped = magic != PCAP_MAGIC && magic != PCAP_MAGIC_NS;
+	magic = pcap_u32(hdr, *is_swapped);
+
+	if (magic != PCAP_MAGIC && magic != PCAP_MAGIC_NS) {
+		fprintf(stderr, "error: '%s' is not a pcap file\n", path);
+		goto err;
+	}
+
+	if (pcap_u32(hdr + 20, *is_swapped) != PCAP_LINKTYPE_ETHER) {
+		fprintf(stderr, "error: '%s' is not an ethernet capture\n",
+				path);
+		goto err;
+	}
+
+	return fp;
+err:
+	fclose(fp);
+	return NULL;
+}
+
+/* 1 for a packet, 0 at the end of the capture */
+static int pcap_next(FILE *fp, bool is_swapped, struct cost_pkt *pkt)
+{
+	uint8_t rec[PCAP_REC_LEN];
+
+	if (fread(rec, sizeof(rec), 1, fp) != 1)
+		return 0;
+
+	pkt->len = pcap_u32(rec + 8, is_swapped);
+	pkt->wire_len = pcap_u32(rec + 12, is_swapped);
+
+	if (pkt->len > PCAP_SNAP_MAX ||
+			fread(pkt->data, 1, pkt->len, fp) != pkt->len) {
+		fprintf(stderr, "error: truncated pcap record\n");
+		return -1;
+	}
+
+	return 1;
+}
+
+static int cost_replay(struct sock_filter *f, int count, char *path,
+		struct cost_capture *cap)
+{
+	bool vlan_untag = cost_reads_vlan(f, count);
+	struct cost_pkt pkt;
+	bool is_swapped;
+	int executed;
+	FILE *fp;
+	int ret;
+
+	fp = pcap_open(path, &is_swapped);
+	if (!fp)
+		return -1;
+
+	pkt.data = xmalloc(PCAP_SNAP_MAX);
+
+	while ((ret = pcap_next(fp, is_swapped, &pkt)) > 0) {
+		cost_pkt_decode(&pkt, vlan_untag);
+
+		if (cost_run(f, count, &pkt, cap->hits, &executed))
+			cap->accepted++;
+
+		cap->packets++;
+		cap->executed += executed;
+		if (executed > cap->max)
+			cap->max = executed;
+	}
+
+	xfree(pkt.data);
+	fclose(fp);
+	return ret;
+}
+
+static void cost_hot_print(struct cost_block *blocks, int blocks_count,
+		double avg)
+{
+	int i;
+
+	qsort(blocks, blocks_count, sizeof(*blocks), cost_block_cmp);
+
+	printf("hottest blocks:\n");
+	for (i = 0; i < blocks_count && i < COST_HOT_MAX; i++) {
+		struct cost_block *b = &blocks[i];
+		char range[32];
+
+		if (b->weight == 0)
+			break;
+
+		snprintf(range, sizeof(range), "L%d-L%d", b->start,
+				b->start + b->len - 1);
+		printf("  %-14s %4d instrs %8.2f per packet %6.1f%%\n", range,
+				b->len, b->weight, 100 * b->weight / avg);
+	}
+}
+
+int cost_report(struct sock_filter *f, int count, char *pcap_path)
+{
+	struct cost_capture cap = { 0 };
+	struct cost_block *blocks;
+	struct cost_path *paths;
+	double *reach;
+	int blocks_count;
+	int ret = -1;
+	int i, j;
+
+	paths = xmalloc(sizeof(struct cost_path) * count);
+	reach = xmalloc(sizeof(double) * count);
+	blocks = xmalloc(sizeof(struct cost_block) * count);
+	cap.hits = xmalloc(sizeof(uint64_t) * count);
+	memset(cap.hits, 0, sizeof(uint64_t) * count);
+
+	if (cost_paths(f, count, paths))
+		goto out;
+
+	if (pcap_path && cost_replay(f, count, pcap_path, &cap))
+		goto out;
+
+	cost_reach(f, count, reach);
+	blocks_count = cost_blocks(f, count, blocks);
+
+	for (i = 0; i < blocks_count; i++) {
+		struct cost_block *b = &blocks[i];
+
+		for (j = b->start; j < b->start + b->len; j++)
+			b->weight += cap.packets ?
+				(double)cap.hits[j] / cap.packets : reach[j];
+	}
+
+	printf("instructions: %d (at most %d)\n", count, BPF_MAXINSNS);
+	printf("paths: %.0f\n", paths[0].count);
+	printf("path length: min %d, max %d, avg %.2f\n", paths[0].min,
+			paths[0].max, paths[0].avg);
+
+	if (pcap_path) {
+		double avg = cap.packets ?
+			(double)cap.executed / cap.packets : 0;
+
+		printf("capture: %llu packets, %llu accepted\n",
+				(unsigned long long)cap.packets,
+				(unsigned long long)cap.accepted);
+		printf("capture path length: max %d, avg %.2f\n", cap.max,
+				avg);
+
+		if (cap.packets)
+			cost_hot_print(blocks, blocks_count, avg);
+	} else {
+		cost_hot_print(blocks, blocks_count, paths[0].avg);
+	}
+
+	if (count > BPF_MAXINSNS) {
+		fprintf(stderr, "error: %d instructions, the kernel takes "
+				"at most %d\n", count, BPF_MAXINSNS);
+		goto out;
+	}
+
+	ret = 0;
+out:
+	xfree(paths);
+	xfree(reach);
+	xfree(blocks);
+	xfree(cap.hits);
+	return ret;
+}
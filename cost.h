@@ -0,0 +1,8 @@
+#ifndef __COST_H__
+#define __COST_H__
+
+#include <linux/filter.h>
+
+int cost_report(struct sock_filter *f, int count, char *pcap_path);
+
+#endif
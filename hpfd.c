@@ -0,0 +1,358 @@
+/*
+ * hpfd.c	filter compilation daemon
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * Authors:	Vadim Kochan <vadim4j@gmail.com>
+ */
+
+/*
+ * Serves compile requests over a unix socket from a pool of threads which
+ * accept connections concurrently. Compiled filters are kept in a LRU
+ * cache, so hot filters are answered without touching the compiler. The
+ * parser and the compiler keep global state, so cache misses are compiled
+ * one at a time.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/un.h>
+#include <sys/socket.h>
+
+#include "list.h"
+#include "hpfd.h"
+#include "utils.h"
+#include "htable.h"
+#include "xmalloc.h"
+#include "compiler.h"
+
+#define CACHE_HTABLE_SIZE	1024
+/* keep freed compiler memory around for the next compile */
+#define ARENA_KEEP_SIZE		(32 << 20)
+
+struct cache_entry {
+	struct hentry hlist;
+	struct list_head lru;
+	uint32_t flags;
+	char *expr;
+	struct sock_filter *code;
+	int count;
+};
+
+static pthread_mutex_t compile_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct htable *cache;
+static struct list_head cache_lru;
+static int cache_count;
+static int cache_max;
+
+static int listen_fd;
+static volatile bool workers_stop;
+
+static unsigned long cache_hash(char *expr, uint32_t flags)
+{
+	return str_hash(expr) ^ flags;
+}
+
+static bool cache_entry_eq(struct hentry *entry, const void *key)
+{
+	struct cache_entry *ce = container_of(entry, struct cache_entry, hlist);
+	const struct cache_entry *k = key;
+
+	return ce->flags == k->flags && strcmp(ce->expr, k->expr) == 0;
+}
+
+static struct cache_entry *cache_find(char *expr, uint32_t flags)
+{
+	struct cache_entry key = { .expr = expr, .flags = flags };
+	struct cache_entry *ce;
+	struct hentry *entry;
+
+	entry = htable_find(cache, cache_hash(expr, flags), &key);
+	if (!entry)
+		return NULL;
+
+	ce = container_of(entry, struct cache_entry, hlist);
+
+	list_move(&ce->lru, &cache_lru);
+	return ce;
+}
+
+static void cache_evict(void)
+{
+	struct cache_entry *ce;
+
+	ce = list_last_entry(&cache_lru, struct cache_entry, lru);
+
+	htable_del(cache, &ce->hlist);
+	list_del(&ce->lru);
+	cache_count--;
+
+	xfree(ce->code);
+	xfree(ce->expr);
+	xfree(ce);
+}
+
+static void cache_insert(char *expr, uint32_t flags, struct sock_filter *code,
+		int count)
+{
+	struct cache_entry *ce;
+
+	if (cache_max <= 0) {
+		xfree(code);
+		return;
+	}
+
+	if (cache_count >= cache_max)
+		cache_evict();
+
+	ce = xmalloc(sizeof(*ce));
+	ce->expr = xmalloc(strlen(expr) + 1);
+	strcpy(ce->expr, expr);
+	ce->flags = flags;
+	ce->code = code;
+	ce->count = count;
+
+	htable_insert(cache, &ce->hlist, cache_hash(expr, flags));
+	list_add(&ce->lru, &cache_lru);
+	cache_count++;
+}
+
+static int read_full(int fd, void *buf, size_t len)
+{
+	char *ptr = buf;
+	ssize_t ret;
+
+	while (len) {
+		ret = read(fd, ptr, len);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return -1;
+
+		ptr += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t len)
+{
+	const char *ptr = buf;
+	ssize_t ret;
+
+	while (len) {
+		ret = write(fd, ptr, len);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return -1;
+
+		ptr += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+static int reply_send(int fd, int status, struct sock_filter *code, int count)
+{
+	struct hpfd_reply reply = {
+		.status	= status,
+		.count	= count > 0 ? count : 0,
+	};
+
+	if (write_full(fd, &reply, sizeof(reply)))
+		return -1;
+	if (reply.count && write_full(fd, code, sizeof(*code) * reply.count))
+		return -1;
+
+	return 0;
+}
+
+static int request_serve(int fd, char *expr, uint32_t flags)
+{
+	struct sock_filter *code;
+	struct cache_entry *ce;
+	int count;
+	int ret;
+
+	/* copy out, so a slow client does not hold the cache */
+	pthread_mutex_lock(&cache_lock);
+	ce = cache_find(expr, flags);
+	if (ce) {
+		count = ce->count;
+		code = xmalloc(sizeof(*code) * count);
+		memcpy(code, ce->code, sizeof(*code) * count);
+	}
+	pthread_mutex_unlock(&cache_lock);
+
+	if (ce) {
+		ret = reply_send(fd, 0, code, count);
+		xfree(code);
+		return ret;
+	}
+
+	pthread_mutex_lock(&compile_lock);
+	count = compile_filter(expr, &code,
+			!(flags & HPFD_OPT_NO_OPTIMIZE), NULL);
+	pthread_mutex_unlock(&compile_lock);
+
+	if (count <= 0)
+		return reply_send(fd, -EINVAL, NULL, 0);
+
+	ret = reply_send(fd, 0, code, count);
+
+	pthread_mutex_lock(&cache_lock);
+	if (!cache_find(expr, flags))
+		cache_insert(expr, flags, code, count);
+	else
+		xfree(code);
+	pthread_mutex_unlock(&cache_lock);
+
+	return ret;
+}
+
+static void client_serve(int fd)
+{
+	struct hpfd_request req;
+	size_t expr_size = 0;
+	char *expr = NULL;
+
+	while (read_full(fd, &req, sizeof(req)) == 0) {
+		if (req.version != HPFD_VERSION ||
+				req.expr_len == 0 || req.expr_len > HPFD_EXPR_MAX) {
+			reply_send(fd, -EPROTO, NULL, 0);
+			break;
+		}
+
+		if (req.expr_len >= expr_size) {
+			if (expr)
+				xfree(expr);
+
+			expr_size = req.expr_len + 1;
+			expr = xmalloc(expr_size);
+		}
+
+		if (read_full(fd, expr, req.expr_len))
+			break;
+		expr[req.expr_len] = '\0';
+
+		if (request_serve(fd, expr, req.flags))
+			break;
+	}
+
+	if (expr)
+		xfree(expr);
+}
+
+static void *worker_run(void *arg)
+{
+	int fd;
+
+	for (;;) {
+		fd = accept(listen_fd, NULL, NULL);
+		if (fd < 0) {
+			if (workers_stop)
+				break;
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+
+			perror("hpfd: accept");
+			break;
+		}
+
+		client_serve(fd);
+		close(fd);
+	}
+
+	return NULL;
+}
+
+static int sock_listen(char *path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "hpfd: socket path is too long\n");
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("hpfd: socket");
+		return -1;
+	}
+
+	unlink(path);
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+			listen(fd, SOMAXCONN)) {
+		perror("hpfd: bind");
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int hpfd_run(char *path, int threads, int cache_size)
+{
+	pthread_t *workers;
+	int err = 0;
+	int i, n;
+
+	listen_fd = sock_listen(path);
+	if (listen_fd < 0)
+		return -1;
+
+	signal(SIGPIPE, SIG_IGN);
+
+	mallopt(M_TRIM_THRESHOLD, ARENA_KEEP_SIZE);
+	mallopt(M_MMAP_THRESHOLD, ARENA_KEEP_SIZE);
+
+	cache = htable_alloc(CACHE_HTABLE_SIZE, cache_entry_eq);
+	INIT_LIST_HEAD(&cache_lru);
+	cache_max = cache_size;
+
+	if (threads <= 0)
+		threads = 1;
+
+	workers = xmalloc(sizeof(pthread_t) * threads);
+	for (i = 0; i < threads; i++) {
+		err = pthread_create(&workers[i], NULL, worker_run, NULL);
+		if (err) {
+			fprintf(stderr, "hpfd: can't start worker: %s\n",
+					strerror(err));
+			break;
+		}
+	}
+
+	/* the workers started so far return from accept() */
+	if (err) {
+		workers_stop = true;
+		shutdown(listen_fd, SHUT_RDWR);
+	}
+
+	for (n = 0; n < i; n++)
+		pthread_join(workers[n], NULL);
+
+	xfree(workers);
+	htable_free(cache);
+	close(listen_fd);
+	unlink(path);
+
+	return err ? -1 : 0;
+}
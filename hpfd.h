@@ -0,0 +1,33 @@
+#ifndef __HPFD_H__
+#define __HPFD_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <linux/filter.h>
+
+#define HPFD_VERSION		1
+#define HPFD_EXPR_MAX		(16 << 20)
+
+#define HPFD_THREADS_DEF	4
+#define HPFD_CACHE_DEF		256
+
+enum {
+	HPFD_OPT_NO_OPTIMIZE	= 1 << 0,
+};
+
+/* followed by expr_len bytes of the filter expression */
+struct hpfd_request {
+	uint32_t version;
+	uint32_t flags;
+	uint32_t expr_len;
+};
+
+/* followed by count struct sock_filter */
+struct hpfd_reply {
+	int32_t status;
+	uint32_t count;
+};
+
+int hpfd_run(char *path, int threads, int cache_size);
+
+#endif
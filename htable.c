@@ -9,11 +9,29 @@
  * Authors:	Vadim Kochan <vadim4j@gmail.com>
  */
 
+/*
+ * Open addressing over groups of 16 slots. Each slot has a control byte:
+ * empty, deleted or the low 7 bits of its member's hash, so a group is
+ * matched against the looked up hash at once and only the slots which
+ * match have their keys compared. The rest of the hash picks the first
+ * group, the next ones are probed quadratically until a group with an
+ * empty slot. The table grows before it is 7/8 full.
+ */
+
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "htable.h"
 #include "xmalloc.h"
 
+#define GROUP_SIZE	16
+
+#define CTRL_EMPTY	0x80
+#define CTRL_DELETED	0xfe
+
 unsigned long str_hash(char *str)
 {
 	unsigned long hash = 0;
@@ -22,66 +40,237 @@ unsigned long str_hash(char *str)
 	while (c = *str++)
 		hash = c + (hash << 6) + (hash << 16) - hash;
 
+	/* the low bits are in the control bytes, so they should be mixed */
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdUL;
+	hash ^= hash >> 33;
+
 	return hash;
 }
 
-struct htable *htable_alloc(int size)
+static inline uint8_t hash_ctrl(unsigned long hash)
+{
+	return hash & 0x7f;
+}
+
+static inline unsigned int hash_group(unsigned long hash)
+{
+	return hash >> 7;
+}
+
+/* bit i is set if the slot i of the group has the control byte */
+static inline unsigned int group_match(uint8_t *group, uint8_t ctrl)
+{
+#ifdef __SSE2__
+	__m128i g = _mm_loadu_si128((__m128i *)group);
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(ctrl)));
+#else
+	unsigned int mask = 0;
+	int i;
+
+	for (i = 0; i < GROUP_SIZE; i++)
+		mask |= (group[i] == ctrl) << i;
+
+	return mask;
+#endif
+}
+
+static int htable_capacity(int size)
+{
+	int cap = GROUP_SIZE;
+
+	while (cap < size)
+		cap <<= 1;
+
+	return cap;
+}
+
+static void htable_slots_alloc(struct htable *ht, int cap)
+{
+	ht->ctrl = xmalloc(cap);
+	memset(ht->ctrl, CTRL_EMPTY, cap);
+
+	ht->slots = xmalloc(sizeof(struct hentry *) * cap);
+	ht->taken = xmalloc(sizeof(unsigned int) * cap);
+	ht->mask = cap - 1;
+	ht->count = 0;
+	ht->used = 0;
+	ht->taken_count = 0;
+}
+
+static void htable_slots_free(struct htable *ht)
+{
+	xfree(ht->ctrl);
+	xfree(ht->slots);
+	xfree(ht->taken);
+}
+
+struct htable *htable_alloc(int size, htable_eq_t eq)
 {
 	struct htable *ht = xmalloc(sizeof(struct htable));
 
 	memset(ht, 0, sizeof(*ht));
+	ht->eq = eq;
 
-	ht->size = size;
-	ht->head = xmalloc(sizeof(struct hentry *) * size);
-	memset(ht->head, 0, sizeof(struct hentry *) * size);
-
+	htable_slots_alloc(ht, htable_capacity(size));
 	return ht;
 }
 
 void htable_reset(struct htable *ht)
 {
-	memset(ht->head, 0, sizeof(struct hentry *) * ht->size);
-	ht->cached = NULL;
+	int i;
+
+	for (i = 0; i < ht->taken_count; i++)
+		ht->ctrl[ht->taken[i]] = CTRL_EMPTY;
+
+	ht->taken_count = 0;
+	ht->count = 0;
+	ht->used = 0;
 }
 
 void htable_free(struct htable *ht)
 {
-	xfree(ht->head);
+	htable_slots_free(ht);
 	xfree(ht);
 }
 
-struct hentry *htable_find(struct htable *ht, unsigned long hash)
+/* slot to put the hash in: the first empty or deleted one on its probe */
+static unsigned int htable_slot_free(struct htable *ht, unsigned long hash)
 {
-	struct hentry *entry;
+	unsigned int groups_mask = ht->mask / GROUP_SIZE;
+	unsigned int group = hash_group(hash) & groups_mask;
+	unsigned int step = 0;
+	unsigned int match;
+
+	for (;;) {
+		uint8_t *ctrl = &ht->ctrl[group * GROUP_SIZE];
+
+		match = group_match(ctrl, CTRL_EMPTY) |
+			group_match(ctrl, CTRL_DELETED);
+		if (match)
+			return group * GROUP_SIZE + __builtin_ctz(match);
+
+		group = (group + ++step) & groups_mask;
+	}
+}
+
+static void htable_slot_set(struct htable *ht, unsigned int slot,
+		struct hentry *entry)
+{
+	if (ht->ctrl[slot] == CTRL_EMPTY) {
+		ht->taken[ht->taken_count++] = slot;
+		ht->used++;
+	}
+
+	ht->ctrl[slot] = hash_ctrl(entry->hash);
+	ht->slots[slot] = entry;
+	ht->count++;
+}
+
+static void htable_resize(struct htable *ht)
+{
+	struct htable old = *ht;
+	int cap = ht->mask + 1;
 	int i;
 
-	if (ht->cached && ht->cached->hash == hash)
-		return ht->cached;
+	/* mostly deleted members are just dropped at the same size */
+	if (ht->count >= ht->used / 2)
+		cap *= 2;
+
+	htable_slots_alloc(ht, cap);
+
+	for (i = 0; i < old.taken_count; i++) {
+		unsigned int slot = old.taken[i];
+		struct hentry *entry;
+
+		if (old.ctrl[slot] & CTRL_EMPTY)
+			continue;
+
+		entry = old.slots[slot];
+		htable_slot_set(ht, htable_slot_free(ht, entry->hash), entry);
+	}
+
+	htable_slots_free(&old);
+}
+
+/* slot of the entry matched by eq (or the entry itself if key is NULL) */
+static int htable_slot_find(struct htable *ht, unsigned long hash,
+		const void *key, struct hentry *entry)
+{
+	unsigned int groups_mask = ht->mask / GROUP_SIZE;
+	unsigned int group = hash_group(hash) & groups_mask;
+	uint8_t ctrl = hash_ctrl(hash);
+	unsigned int step = 0;
+	unsigned int match;
+
+	for (;;) {
+		uint8_t *group_ctrl = &ht->ctrl[group * GROUP_SIZE];
+		unsigned int slot;
+
+		match = group_match(group_ctrl, ctrl);
+		while (match) {
+			slot = group * GROUP_SIZE + __builtin_ctz(match);
+			match &= match - 1;
 
-	entry = ht->head[hash & (ht->size - 1)];
-	while (entry && entry->hash != hash)
-		entry = entry->next;
+			if (entry ? ht->slots[slot] == entry :
+					ht->slots[slot]->hash == hash &&
+					ht->eq(ht->slots[slot], key))
+				return slot;
+		}
 
-	if (entry && entry->hash != hash)
-		return NULL;
+		/* the probe of the hash ends at an empty slot */
+		if (group_match(group_ctrl, CTRL_EMPTY))
+			return -1;
+
+		group = (group + ++step) & groups_mask;
+		if (step > groups_mask)
+			return -1;
+	}
+}
+
+struct hentry *htable_find(struct htable *ht, unsigned long hash,
+		const void *key)
+{
+	int slot = htable_slot_find(ht, hash, key, NULL);
 
-	ht->cached = entry;
-	return entry;
+	return slot < 0 ? NULL : ht->slots[slot];
 }
 
 struct hentry *htable_find_name(struct htable *ht, char *name)
 {
-	return htable_find(ht, str_hash(name));
+	return htable_find(ht, str_hash(name), name);
 }
 
 void htable_insert(struct htable *ht, struct hentry *entry, unsigned long hash)
 {
-	entry->next = ht->head[hash & (ht->size - 1)];
+	unsigned int slot;
+
 	entry->hash = hash;
-	ht->head[hash & (ht->size - 1)] = entry;
+
+	slot = htable_slot_free(ht, hash);
+	/* a deleted slot is reused, an empty one makes the table fuller */
+	if (ht->ctrl[slot] == CTRL_EMPTY &&
+			(ht->used + 1) * 8 > (int)(ht->mask + 1) * 7) {
+		htable_resize(ht);
+		slot = htable_slot_free(ht, hash);
+	}
+
+	htable_slot_set(ht, slot, entry);
 }
 
 void htable_insert_name(struct htable *ht, struct hentry *entry, char *name)
 {
 	htable_insert(ht, entry, str_hash(name));
 }
+
+void htable_del(struct htable *ht, struct hentry *entry)
+{
+	int slot = htable_slot_find(ht, entry->hash, NULL, entry);
+
+	if (slot < 0)
+		return;
+
+	ht->ctrl[slot] = CTRL_DELETED;
+	ht->count--;
+}
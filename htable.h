@@ -1,27 +1,43 @@
 #ifndef __HTABLE_H__
 #define __HTABLE_H__
 
+#include <stdint.h>
+#include <stdbool.h>
+
 #define HTABLE_SIZE 256
 
+/* embedded into the table members, the key is kept by the member */
 struct hentry {
-	struct hentry *next;
 	unsigned long hash;
 };
 
+/* tells if the member's key is the looked up one */
+typedef bool (*htable_eq_t)(struct hentry *entry, const void *key);
+
 struct htable {
-	int size;
-	struct hentry **head;
-	struct hentry *cached;
+	/* per slot: empty, deleted or 7 bits of the member's hash */
+	uint8_t *ctrl;
+	struct hentry **slots;
+	unsigned int mask;
+	int count;
+	/* members and deleted ones, they both make the probes longer */
+	int used;
+	htable_eq_t eq;
+	/* slots taken since the reset, so it clears only them */
+	unsigned int *taken;
+	int taken_count;
 };
 
 unsigned long str_hash(char *str);
 
-struct htable *htable_alloc(int size);
+struct htable *htable_alloc(int size, htable_eq_t eq);
 void htable_reset(struct htable *ht);
 void htable_free(struct htable *ht);
-struct hentry *htable_find(struct htable *ht, unsigned long hash);
+struct hentry *htable_find(struct htable *ht, unsigned long hash,
+		const void *key);
 struct hentry *htable_find_name(struct htable *ht, char *name);
 void htable_insert(struct htable *ht, struct hentry *entry, unsigned long hash);
 void htable_insert_name(struct htable *ht, struct hentry *entry, char *name);
+void htable_del(struct htable *ht, struct hentry *entry);
 
 #endif
@@ -10,14 +10,27 @@
  */
 
 #include "proto.h"
+#include "proto_registers.h"
 
 #define ETH_NAME(fld) "ether."fld
+#define VLAN_NAME(fld) "vlan."fld
+
+#define ETH_P_8021Q	0x8100
+#define ETH_P_8021AD	0x88a8
+#define ETH_P_QINQ1	0x9100
+
+#define VLAN_VID_MASK	0x0fff
+#define VLAN_DEI_MASK	0x1000
+#define VLAN_PCP_MASK	0xe000
+
+static vlan_mode_t vlan_mode;
 
 struct proto_field ether_fields[] = {
 	{
 		.name	= ETH_NAME("type"),
 		.offset = 12,
 		.len = 2,
+		.after_tags = true,
 	},
 	{},
 };
@@ -25,10 +38,106 @@ struct proto_field ether_fields[] = {
 struct proto ether_proto = {
 	.layer	= LAYER_LINK,
 	.name	= "ether",
+	.hdr_len = 14,
 	.fields = ether_fields,
+	.next_name = ETH_NAME("type"),
+	.tags = {
+		.offset	= 12,
+		.len	= 4,
+		.ids	= { ETH_P_8021Q, ETH_P_8021AD, ETH_P_QINQ1 },
+	},
+};
+
+/* outer tag in the packet, fields are relative to its TPID */
+struct proto_field vlan_fields[] = {
+	{
+		.name	= VLAN_NAME("tpid"),
+		.offset	= 0,
+		.len	= 2,
+	},
+	{
+		.name	= VLAN_NAME("id"),
+		.offset	= 2,
+		.len	= 2,
+		.mask	= VLAN_VID_MASK,
+	},
+	{
+		.name	= VLAN_NAME("dei"),
+		.offset	= 2,
+		.len	= 2,
+		.mask	= VLAN_DEI_MASK,
+	},
+	{
+		.name	= VLAN_NAME("pcp"),
+		.offset	= 2,
+		.len	= 2,
+		.mask	= VLAN_PCP_MASK,
+	},
+	{},
 };
 
+/* outer tag stripped by the kernel, ancillary loads are words */
+struct proto_field vlan_anc_fields[] = {
+	{
+		.name	= VLAN_NAME("present"),
+		.offset	= SKF_AD_OFF + SKF_AD_VLAN_TAG_PRESENT,
+		.len	= 4,
+	},
+	{
+		.name	= VLAN_NAME("id"),
+		.offset	= SKF_AD_OFF + SKF_AD_VLAN_TAG,
+		.len	= 4,
+		.mask	= VLAN_VID_MASK,
+	},
+	{
+		.name	= VLAN_NAME("dei"),
+		.offset	= SKF_AD_OFF + SKF_AD_VLAN_TAG,
+		.len	= 4,
+		.mask	= VLAN_DEI_MASK,
+	},
+	{
+		.name	= VLAN_NAME("pcp"),
+		.offset	= SKF_AD_OFF + SKF_AD_VLAN_TAG,
+		.len	= 4,
+		.mask	= VLAN_PCP_MASK,
+	},
+	{},
+};
+
+struct proto vlan_proto = {
+	.layer	= LAYER_LINK,
+	.name	= "vlan",
+};
+
+void link_protos_vlan_mode(vlan_mode_t mode)
+{
+	vlan_mode = mode;
+}
+
 void link_protos_register(void)
 {
+	switch (vlan_mode) {
+	case VLAN_NONE:
+		ether_proto.tags.max = 0;
+		break;
+	case VLAN_PACKET:
+		/* 802.1ad outer tag and 802.1Q inner one */
+		ether_proto.tags.max = 2;
+
+		vlan_proto.lower_name = "ether";
+		vlan_proto.is_tag = true;
+		vlan_proto.fields = vlan_fields;
+		break;
+	case VLAN_ANCILLARY:
+		/* the inner tag of QinQ is left in the packet */
+		ether_proto.tags.max = 1;
+
+		vlan_proto.present_name = VLAN_NAME("present");
+		vlan_proto.fields = vlan_anc_fields;
+		break;
+	}
+
 	proto_register(&ether_proto);
+	if (vlan_mode != VLAN_NONE)
+		proto_register(&vlan_proto);
 }
@@ -10,46 +10,208 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <getopt.h>
 #include <string.h>
 #include <stdbool.h>
 
 #include "bpf.h"
+#include "cost.h"
+#include "bench.h"
 #include "proto.h"
+#include "hpfd.h"
+#include "clauses.h"
 #include "compiler.h"
+#include "peephole.h"
+#include "proto_spec.h"
 #include "proto_registers.h"
 
-static const char *opts = "de:O";
+static const char *opts = "de:f:Os::ID:T:C:V:S:K:P:E:B::u::Wc::N";
 
 static const struct option long_opts[] = {
-	{ "dump",		no_argument,	NULL,	'd' },
-	{ "expr",		no_argument,	NULL,	'e' },
-	{ "no-optimize",	no_argument,	NULL,	'O' },
+	{ "dump",		no_argument,		NULL,	'd' },
+	{ "expr",		required_argument,	NULL,	'e' },
+	{ "file",		required_argument,	NULL,	'f' },
+	{ "no-optimize",	no_argument,		NULL,	'O' },
+	{ "stats",		optional_argument,	NULL,	's' },
+	{ "incremental",	no_argument,		NULL,	'I' },
+	{ "daemon",		required_argument,	NULL,	'D' },
+	{ "threads",		required_argument,	NULL,	'T' },
+	{ "cache-size",		required_argument,	NULL,	'C' },
+	{ "vlan",		required_argument,	NULL,	'V' },
+	{ "shard",		required_argument,	NULL,	'S' },
+	{ "shard-key",		required_argument,	NULL,	'K' },
+	{ "protos",		required_argument,	NULL,	'P' },
+	{ "ipv6-ext-depth",	required_argument,	NULL,	'E' },
+	{ "bench",		optional_argument,	NULL,	'B' },
+	{ "union",		optional_argument,	NULL,	'u' },
+	{ "peephole-check",	no_argument,		NULL,	'W' },
+	{ "cost",		optional_argument,	NULL,	'c' },
+	{ "no-verify",		no_argument,		NULL,	'N' },
 	{ NULL, 0, NULL, 0 },
 };
 
-static void protos_register(void)
+/* symmetric for both directions of a TCP or UDP flow */
+#define SHARD_KEY_DEF	"ipv4.src,ipv4.dst,tcp.sport,tcp.dport"
+
+#define PROTO_FILES_MAX	16
+#define UNION_EXPRS_MAX	1024
+
+static char *proto_files[PROTO_FILES_MAX];
+static int proto_files_count;
+
+static char *union_exprs[UNION_EXPRS_MAX];
+static int union_count;
+
+static int union_add(char *expr)
+{
+	if (union_count == UNION_EXPRS_MAX) {
+		printf("too many filters to merge\n");
+		return -1;
+	}
+
+	union_exprs[union_count++] = expr;
+	return 0;
+}
+
+/* each non empty line of the file is a filter */
+static int union_file_read(char *path)
+{
+	size_t len = 0;
+	char *line = NULL;
+	int ret = 0;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		printf("can't open '%s'\n", path);
+		return -1;
+	}
+
+	while (getline(&line, &len, fp) > 0) {
+		line[strcspn(line, "\r\n")] = '\0';
+		if (line[strspn(line, " \t")] == '\0')
+			continue;
+
+		ret = union_add(strdup(line));
+		if (ret)
+			break;
+	}
+
+	free(line);
+	fclose(fp);
+	return ret;
+}
+
+/* -u can follow -e, so the filters are collected by another pass */
+static int union_args_read(int argc, char **argv)
+{
+	int opt;
+	int idx;
+
+	opterr = 0;
+	optind = 0;
+
+	while ((opt = getopt_long(argc, argv, opts, long_opts, &idx)) != EOF) {
+		if (opt == 'e' && union_add(strdup(optarg)))
+			return -1;
+	}
+
+	return 0;
+}
+
+static void union_free(void)
+{
+	while (union_count)
+		free(union_exprs[--union_count]);
+}
+
+static int protos_register(void)
 {
+	int i;
+
 	/* should be called first */
 	proto_init();
 
 	link_protos_register();
 	net_protos_register();
+	trans_protos_register();
+	skb_protos_register();
+	tunnel_protos_register();
+
+	for (i = 0; i < proto_files_count; i++) {
+		if (proto_spec_load(proto_files[i]))
+			return -1;
+	}
+
+	/* should be called after all the protocols are registered */
+	proto_fields_build();
+	return 0;
 }
 
 static void protos_unregister(void)
 {
+	proto_spec_unload();
+	tunnel_protos_unregister();
+
 	/* should be called last */
 	proto_cleanup();
 }
 
+static int shards_dump(char *expr, int shards, char *key, bool do_optimize,
+		bool show_dump)
+{
+	struct sock_filter *f;
+	int ins_count;
+	int jmp_idx;
+	int i;
+
+	if (!expr) {
+		printf("shards need the expression '-e'\n");
+		return -1;
+	}
+
+	ins_count = compile_filter_shard(expr, &f, do_optimize, shards, key,
+			&jmp_idx);
+	if (ins_count <= 0)
+		return ins_count < 0 ? -1 : 0;
+
+	for (i = 0; i < shards; i++) {
+		if (jmp_idx >= 0)
+			f[jmp_idx].k = i;
+
+		if (show_dump) {
+			printf("shard %d:\n", i);
+			bpf_dump(f, ins_count);
+		}
+	}
+
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
+	struct compiler_stats stats;
+	stats_fmt_t stats_fmt = STATS_FMT_TEXT;
 	struct sock_filter *f;
 	bool do_optimize = true;
+	bool show_stats = false;
 	bool show_dump = false;
+	bool show_cost = false;
+	char *cost_pcap = NULL;
+	int cache_size = HPFD_CACHE_DEF;
+	int threads = HPFD_THREADS_DEF;
+	bool incremental = false;
+	bool bench = false;
+	bool is_union = false;
+	bool union_index = false;
+	char *bench_family = NULL;
+	char *sock_path = NULL;
+	char *shard_key = SHARD_KEY_DEF;
+	int shards = 0;
+	char *file = NULL;
+	char *expr = NULL;
 	int ins_count;
-	char *expr;
 	int opt;
 	int idx;
 
@@ -59,24 +221,173 @@ int main(int argc, char **argv)
 			show_dump = true;
 			break;
 		case 'e':
-			expr = strdup(optarg);
+			expr = optarg;
+			break;
+		case 'f':
+			file = optarg;
 			break;
 		case 'O':
 			do_optimize = false;
 			break;
+		case 's':
+			show_stats = true;
+
+			if (optarg && strcmp(optarg, "json") == 0) {
+				stats_fmt = STATS_FMT_JSON;
+			} else if (optarg && strcmp(optarg, "text") != 0) {
+				printf("unknown stats format '%s'\n", optarg);
+				return -1;
+			}
+			break;
+		case 'I':
+			incremental = true;
+			break;
+		case 'D':
+			sock_path = optarg;
+			break;
+		case 'T':
+			threads = atoi(optarg);
+			break;
+		case 'C':
+			cache_size = atoi(optarg);
+			break;
+		case 'V':
+			if (strcmp(optarg, "packet") == 0) {
+				link_protos_vlan_mode(VLAN_PACKET);
+			} else if (strcmp(optarg, "ancillary") == 0) {
+				link_protos_vlan_mode(VLAN_ANCILLARY);
+			} else {
+				printf("unknown vlan mode '%s'\n", optarg);
+				return -1;
+			}
+			break;
+		case 'S':
+			shards = atoi(optarg);
+			if (shards <= 0) {
+				printf("wrong number of shards '%s'\n", optarg);
+				return -1;
+			}
+			break;
+		case 'K':
+			shard_key = optarg;
+			break;
+		case 'E':
+			if (net_protos_ipv6_ext_depth(atoi(optarg))) {
+				printf("wrong IPv6 extension headers depth '%s'\n",
+						optarg);
+				return -1;
+			}
+			break;
+		case 'u':
+			is_union = true;
+
+			if (optarg && strcmp(optarg, "index") == 0) {
+				union_index = true;
+			} else if (optarg) {
+				printf("unknown union option '%s'\n", optarg);
+				return -1;
+			}
+			break;
+		case 'W':
+			return peephole_check();
+		case 'c':
+			show_cost = true;
+			cost_pcap = optarg;
+			break;
+		case 'N':
+			compile_verify_set(false);
+			break;
+		case 'B':
+			bench = true;
+			bench_family = optarg;
+			break;
+		case 'P':
+			if (proto_files_count == PROTO_FILES_MAX) {
+				printf("too many protocol files\n");
+				return -1;
+			}
+			proto_files[proto_files_count++] = optarg;
+			break;
 		}
 	}
 
-	if (!expr) {
-		printf("expresion is not specified '-e'\n");
+	if (sock_path) {
+		int ret;
+
+		if (protos_register()) {
+			protos_unregister();
+			return -1;
+		}
+		ret = hpfd_run(sock_path, threads, cache_size);
+		protos_unregister();
+		return ret;
+	}
+
+	if (bench) {
+		int ret;
+
+		if (protos_register()) {
+			protos_unregister();
+			return -1;
+		}
+		ret = bench_run(bench_family, do_optimize);
+		protos_unregister();
+		return ret;
+	}
+
+	if (incremental) {
+		if (protos_register()) {
+			protos_unregister();
+			return -1;
+		}
+		clauses_run(do_optimize);
+		protos_unregister();
+		return 0;
+	}
+
+	if (!expr && !file) {
+		printf("expresion is not specified '-e' or '-f'\n");
+		return -1;
+	}
+
+	if (protos_register()) {
+		protos_unregister();
 		return -1;
 	}
 
-	protos_register();
+	if (shards) {
+		int ret = shards_dump(expr, shards, shard_key, do_optimize,
+				show_dump);
+
+		protos_unregister();
+		return ret;
+	}
+
+	if (is_union && (union_args_read(argc, argv) ||
+			(file && union_file_read(file)))) {
+		union_free();
+		protos_unregister();
+		return -1;
+	}
 
-	ins_count = compile_filter(expr, &f, do_optimize);
-	if (ins_count && show_dump)
+	if (is_union)
+		ins_count = compile_filter_union(union_exprs, union_count, &f,
+				do_optimize, union_index,
+				show_stats ? &stats : NULL);
+	else if (file)
+		ins_count = compile_filter_file(file, &f, do_optimize,
+				show_stats ? &stats : NULL);
+	else
+		ins_count = compile_filter(expr, &f, do_optimize,
+				show_stats ? &stats : NULL);
+	if (ins_count > 0 && show_dump)
 		bpf_dump(f, ins_count);
+	if (ins_count > 0 && show_cost && cost_report(f, ins_count, cost_pcap))
+		ins_count = -1;
+	if (show_stats)
+		stats_print(stdout, &stats, stats_fmt);
 
+	union_free();
 	protos_unregister();
+	return ins_count < 0 ? -1 : 0;
 }
@@ -10,19 +10,77 @@
  */
 
 #include "proto.h"
+#include "proto_registers.h"
 
 #define IPV4_NAME(fld) "ipv4."fld
+#define IPV6_NAME(fld) "ipv6."fld
+
+#define IPV6_EXT_DEPTH_DEF	4
 
 struct proto_field ipv4_fields[] = {
 	{
 		.name	= IPV4_NAME("ver"),
 		.offset	= 0,
-		.mask	= 0xf,
+		.len	= 1,
+		.mask	= 0xf0,
 	},
 	{
 		.name	= IPV4_NAME("ihl"),
 		.offset	= 0,
-		.mask	= 0xf0,
+		.len	= 1,
+		.mask	= 0xf,
+	},
+	{
+		.name	= IPV4_NAME("tos"),
+		.offset	= 1,
+		.len	= 1,
+	},
+	{
+		.name	= IPV4_NAME("len"),
+		.offset	= 2,
+		.len	= 2,
+	},
+	{
+		.name	= IPV4_NAME("id"),
+		.offset	= 4,
+		.len	= 2,
+	},
+	{
+		.name	= IPV4_NAME("flags"),
+		.offset	= 6,
+		.len	= 2,
+		.mask	= 0xe000,
+	},
+	{
+		.name	= IPV4_NAME("frag"),
+		.offset	= 6,
+		.len	= 2,
+		.mask	= 0x1fff,
+	},
+	{
+		.name	= IPV4_NAME("ttl"),
+		.offset	= 8,
+		.len	= 1,
+	},
+	{
+		.name	= IPV4_NAME("proto"),
+		.offset	= 9,
+		.len	= 1,
+	},
+	{
+		.name	= IPV4_NAME("csum"),
+		.offset	= 10,
+		.len	= 2,
+	},
+	{
+		.name	= IPV4_NAME("src"),
+		.offset	= 12,
+		.len	= 4,
+	},
+	{
+		.name	= IPV4_NAME("dst"),
+		.offset	= 16,
+		.len	= 4,
 	},
 	{},
 };
@@ -30,10 +88,92 @@ struct proto_field ipv4_fields[] = {
 struct proto ipv4_proto = {
 	.layer	= LAYER_NETWORK,
 	.name	= "ipv4",
+	.id	= 0x800,
+	.lower_name = "ether",
+	.var_len = {
+		.offset	= 0,
+		.mask	= 0xf,
+		.scale	= 4,
+	},
 	.fields = ipv4_fields,
+	.next_name = IPV4_NAME("proto"),
+	.frag_name = IPV4_NAME("frag"),
+};
+
+struct proto_field ipv6_fields[] = {
+	{
+		.name	= IPV6_NAME("ver"),
+		.offset	= 0,
+		.len	= 1,
+		.mask	= 0xf0,
+	},
+	{
+		.name	= IPV6_NAME("tc"),
+		.offset	= 0,
+		.len	= 2,
+		.mask	= 0x0ff0,
+	},
+	{
+		.name	= IPV6_NAME("flow"),
+		.offset	= 0,
+		.len	= 4,
+		.mask	= 0xfffff,
+	},
+	{
+		.name	= IPV6_NAME("plen"),
+		.offset	= 4,
+		.len	= 2,
+	},
+	{
+		.name	= IPV6_NAME("nxt"),
+		.offset	= 6,
+		.len	= 1,
+	},
+	{
+		.name	= IPV6_NAME("hlim"),
+		.offset	= 7,
+		.len	= 1,
+	},
+	{
+		.name	= IPV6_NAME("src"),
+		.offset	= 8,
+		.len	= 16,
+	},
+	{
+		.name	= IPV6_NAME("dst"),
+		.offset	= 24,
+		.len	= 16,
+	},
+	{},
 };
 
+struct proto ipv6_proto = {
+	.layer	= LAYER_NETWORK,
+	.name	= "ipv6",
+	.id	= 0x86dd,
+	.lower_name = "ether",
+	.hdr_len = 40,
+	/* hop-by-hop, routing, fragment and destination options */
+	.ext = {
+		.max	= IPV6_EXT_DEPTH_DEF,
+		.ids	= { 0, 43, 44, 60 },
+		.frag_id = 44,
+	},
+	.fields = ipv6_fields,
+	.next_name = IPV6_NAME("nxt"),
+};
+
+int net_protos_ipv6_ext_depth(int depth)
+{
+	if (depth < 0 || depth > PROTO_EXT_MAX)
+		return -1;
+
+	ipv6_proto.ext.max = depth;
+	return 0;
+}
+
 void net_protos_register(void)
 {
 	proto_register(&ipv4_proto);
+	proto_register(&ipv6_proto);
 };
@@ -9,6 +9,7 @@
  * Authors:	Vadim Kochan <vadim4j@gmail.com>
  */
 
+#include "stats.h"
 #include "htable.h"
 #include "xmalloc.h"
 #include "compiler.h"
@@ -23,6 +24,10 @@
 static int instr_count;
 static bool is_code_modified;
 
+static int iterations;
+static int removed_fold;
+static int removed_dead;
+
 struct regs_info {
 	int src[2];
 	int dst;
@@ -43,6 +48,8 @@ struct value_instr {
 
 static int max_values;
 static int values_counter;
+/* M[] registers read by other blocks */
+static uint32_t live_regs;
 
 static struct value *values;
 static struct value_instr *value_instrs;
@@ -74,19 +81,16 @@ static inline unsigned int instr_hash(int code, int arg0, int arg1)
 
 static inline int value_new(void)
 {
-	return ++values_counter;
+	values[++values_counter].is_const = false;
+	return values_counter;
 }
 
-static void blocks_init(void)
+/* values are numbered per block, only the ones it used are dropped */
+static void block_init(void)
 {
 	values_counter = 0;
+	value_instrs_new = value_instrs;
 	htable_reset(instrs);
-	memset(values, 0, max_values * 3 * sizeof(struct value));
-	memset(value_instrs, 0, max_values * 3 * sizeof(struct value_instr));
-}
-
-static void block_uninit(void)
-{
 }
 
 static void instr_regs_info(struct instr *ins, struct regs_info *regs)
@@ -167,14 +171,24 @@ static inline void instr_modify(struct instr *ins,
 	is_code_modified = true;
 }
 
+static bool value_instr_eq(struct hentry *entry, const void *key)
+{
+	struct value_instr *vi = container_of(entry, struct value_instr, hlist);
+	const struct value_instr *k = key;
+
+	return vi->code == k->code && vi->arg0 == k->arg0 &&
+		vi->arg1 == k->arg1;
+}
+
 static int instr_eval(int code, int arg0, int arg1)
 {
 	unsigned int hash = instr_hash(code, arg0, arg1);
+	struct value_instr key = { .code = code, .arg0 = arg0, .arg1 = arg1 };
 	struct value_instr *found;
 	struct value_instr *new;
 	struct hentry *entry;
 
-	if ((entry = htable_find(instrs, hash))) {
+	if ((entry = htable_find(instrs, hash, &key))) {
 		found = container_of(entry, struct value_instr, hlist);
 		return found->value_idx;
 	}
@@ -218,6 +232,15 @@ static inline int32_t value_get(int idx)
 	return values[idx].value;
 }
 
+/* the constant has one value, which is known wherever it is numbered */
+static int value_imm(uint32_t k)
+{
+	int idx = instr_eval(BPF_LD_HASH, k, 0);
+
+	value_set(idx, k);
+	return idx;
+}
+
 static void optimize_reg(struct instr *ins, int *reg, int value)
 {
 	if (*reg == value)
@@ -226,6 +249,13 @@ static void optimize_reg(struct instr *ins, int *reg, int value)
 		*reg = value;
 }
 
+/* division by zero is left to the program, it returns 0 there */
+static bool value_is_zero_divisor(int code, int val_idx)
+{
+	return (BPF_OP(code) == BPF_DIV || BPF_OP(code) == BPF_MOD) &&
+		value_get(val_idx) == 0;
+}
+
 static void instr_calc_value(struct instr *ins, int val_idx0, int val_idx1)
 {
 	uint32_t val0 = value_get(val_idx0);
@@ -244,14 +274,10 @@ static void instr_calc_value(struct instr *ins, int val_idx0, int val_idx1)
 		val0 *= val1;
 		break;
 	case BPF_DIV:
-		if (val1 == 0)
-			printf("division by zero");
 		val0 /= val1;
 		break;
 
 	case BPF_MOD:
-		if (val1 == 0)
-			printf("modulus by zero");
 		val0 %= val1;
 		break;
 
@@ -264,7 +290,7 @@ static void instr_calc_value(struct instr *ins, int val_idx0, int val_idx1)
 		break;
 
 	case BPF_XOR:
-		val0 ^= val0;
+		val0 ^= val1;
 		break;
 
 	case BPF_LSH:
@@ -288,14 +314,12 @@ static void optimize_instr_eval(struct instr *ins, int regs[])
 
 	switch (ins->code) {
 	case BPF_LD | BPF_IMM:
-		val_idx = instr_eval(BPF_LD_HASH, ins->k, 0);
+		val_idx = value_imm(ins->k);
 		optimize_reg(ins, &regs[REG_A], val_idx);
-		value_set(val_idx, ins->k);
 		break;
 	case BPF_LDX | BPF_IMM:
-		val_idx = instr_eval(BPF_LD_HASH, ins->k, 0);
+		val_idx = value_imm(ins->k);
 		optimize_reg(ins, &regs[REG_X], val_idx);
-		value_set(val_idx, ins->k);
 		break;
 	case BPF_LD | BPF_MEM:
 		val_idx = regs[ins->k];
@@ -332,11 +356,12 @@ static void optimize_instr_eval(struct instr *ins, int regs[])
 	case BPF_ALU|BPF_XOR|BPF_K:
 	case BPF_ALU|BPF_LSH|BPF_K:
 	case BPF_ALU|BPF_RSH|BPF_K:
-		val_idx = instr_eval(BPF_LD_HASH, ins->k, 0);
+		val_idx = value_imm(ins->k);
 
-		if (value_is_const(regs[REG_A])) {
+		if (value_is_const(regs[REG_A]) &&
+				!value_is_zero_divisor(ins->code, val_idx)) {
 			instr_calc_value(ins, regs[REG_A], val_idx);
-			val_idx = instr_eval(BPF_LD_HASH, ins->k, 0);
+			val_idx = value_imm(ins->k);
 			regs[REG_A] = val_idx;
 			break;
 		}
@@ -353,24 +378,31 @@ static void optimize_instr_eval(struct instr *ins, int regs[])
 	case BPF_ALU|BPF_XOR|BPF_X:
 	case BPF_ALU|BPF_LSH|BPF_X:
 	case BPF_ALU|BPF_RSH|BPF_X:
-		val_idx = instr_eval(BPF_LD_HASH, ins->k, 0);
+		val_idx = value_imm(ins->k);
 
-		if (value_is_const(regs[REG_X])) {
+		if (value_is_const(regs[REG_X]) &&
+				!value_is_zero_divisor(ins->code, regs[REG_X])) {
 			if (value_is_const(regs[REG_A])) {
 				instr_calc_value(ins, regs[REG_A], regs[REG_X]);
-				val_idx = instr_eval(BPF_LD_HASH, ins->k, 0);
+				val_idx = value_imm(ins->k);
 				regs[REG_A] = val_idx;
 			} else {
 				int code = BPF_ALU | BPF_K | BPF_OP(ins->code);
 
 				val_idx = value_get(regs[REG_X]);
 				instr_modify(ins, code, -1, -1, val_idx);
-				val_idx = instr_eval(BPF_LD_HASH, ins->k, 0);
+				val_idx = value_imm(ins->k);
 				regs[REG_A] = instr_eval(ins->code,
 						regs[REG_A], val_idx);
 			}
 			break;
 		}
+
+		regs[REG_A] = instr_eval(ins->code, regs[REG_A], regs[REG_X]);
+		break;
+	case BPF_LDX|BPF_B|BPF_MSH:
+		val_idx = instr_eval(ins->code, ins->k, 0);
+		optimize_reg(ins, &regs[REG_X], val_idx);
 		break;
 	case BPF_LD|BPF_ABS|BPF_W:
 	case BPF_LD|BPF_ABS|BPF_H:
@@ -395,9 +427,29 @@ static void optimize_instr_eval(struct instr *ins, int regs[])
 
 		optimize_reg(ins, &regs[REG_A], val_idx);
 		break;
+	default: {
+		struct regs_info info;
+
+		/* anything else gives a value nothing is known about */
+		instr_regs_info(ins, &info);
+		if (info.dst >= 0)
+			regs[info.dst] = value_new();
+		break;
+	}
 	}
 }
 
+/* compare with an immediate, so X is not needed for the jump */
+static void optimize_jmp_eval(struct instr *ins, int regs[])
+{
+	if (BPF_CLASS(ins->code) != BPF_JMP || BPF_SRC(ins->code) != BPF_X)
+		return;
+
+	if (value_is_const(regs[REG_X]))
+		instr_modify(ins, ins->code & ~BPF_X, -1, -1,
+				value_get(regs[REG_X]));
+}
+
 static void optimize_eval(struct block *blk)
 {
 	struct list_head *pos;
@@ -407,6 +459,9 @@ static void optimize_eval(struct block *blk)
 
 		optimize_instr_eval(ins, blk->regs);
 	}
+
+	if (blk->jmp_instr)
+		optimize_jmp_eval(blk->jmp_instr, blk->regs);
 }
 
 static void optimize_dead(struct instr *ins, struct instr *regs_instr[])
@@ -447,39 +502,224 @@ static void optimize_dead_instrs(struct block *blk)
 	if (blk->jmp_instr)
 		optimize_dead(blk->jmp_instr, regs_instr);
 
-	for (i = 0; i < REGS_MAX; i++)
-		if (regs_instr[i]) {
+	for (i = 0; i < REGS_MAX; i++) {
+		if (i < REGS_MEM_MAX && (live_regs & (1 << i)))
+			continue;
+
+		if (regs_instr[i])
 			instr_set_optimized(regs_instr[i]);
-		}
+	}
 }
 
 static void optimize_block(struct block *blk)
 {
-	memset(blk->regs, 0, sizeof(blk->regs));
+	int count;
+	int i;
 
+	block_init();
+
+	for (i = 0; i < REGS_MAX; i++)
+		blk->regs[i] = value_new();
+
+	count = instr_count;
 	optimize_eval(blk);
+	removed_fold += count - instr_count;
+
+	count = instr_count;
 	optimize_dead_instrs(blk);
+	removed_dead += count - instr_count;
 }
 
+/*
+ * A block starts with registers nothing is known about and the M[] ones
+ * live across blocks are never dropped, so what is done to a block does
+ * not change what can be done to the others. Only the block which was
+ * modified is run again, until it is not.
+ */
 static void optimize_blocks(struct compiler *comp)
+{
+	struct block *blk;
+	int passes;
+
+	list_for_each_entry(blk, &comp->blocks, list) {
+		passes = 0;
+
+		do {
+			is_code_modified = false;
+			optimize_block(blk);
+			passes++;
+		} while (is_code_modified);
+
+		if (passes > iterations)
+			iterations = passes;
+	}
+}
+
+static bool instr_is_live(struct instr *ins)
+{
+	return ins && !ins->is_optimized;
+}
+
+static bool instr_writes_x(struct instr *ins)
+{
+	struct regs_info regs;
+
+	instr_regs_info(ins, &regs);
+	return regs.dst == REG_X;
+}
+
+static bool instr_is_hdr_load(struct instr *ins, int reg)
+{
+	return ins->code == (BPF_LDX | BPF_MEM) && ins->k == reg;
+}
+
+static bool block_stores_x(struct block *blk, int reg)
+{
+	struct instr *ins;
+
+	list_for_each_entry(ins, &blk->instrs->list, list) {
+		if (instr_is_live(ins) && ins->code == BPF_STX && ins->k == reg)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Checks that X is written only by reloads of the header offset in M[reg]
+ * after a block stored it there (the root one, or the guards of the header
+ * on the paths which read it), so X holds it in every block reading it.
+ */
+static bool hdr_x_is_kept(struct compiler *comp, int reg)
+{
+	struct list_head *pos;
+	struct block *blk;
+
+	list_for_each_entry(blk, &comp->blocks, list) {
+		bool is_stored = !block_stores_x(blk, reg);
+
+		list_for_each(pos, &blk->instrs->list) {
+			struct instr *ins = container_of(pos, struct instr, list);
+
+			if (!instr_is_live(ins))
+				continue;
+
+			if (ins->code == BPF_STX && ins->k == reg) {
+				is_stored = true;
+				continue;
+			}
+
+			/* the offset is computed by steps */
+			if (ins->code == BPF_ST && ins->k == reg)
+				return false;
+
+			if (is_stored && instr_writes_x(ins) &&
+					!instr_is_hdr_load(ins, reg))
+				return false;
+		}
+
+		if (instr_is_live(blk->jmp_instr) &&
+				instr_writes_x(blk->jmp_instr))
+			return false;
+	}
+
+	return true;
+}
+
+/* drops the header offset reloads when X can hold it for the program */
+static void optimize_hdr_x(struct compiler *comp)
 {
 	struct list_head *pos;
+	struct block *blk;
+	int reg = -1;
 
-	blocks_init();
+	list_for_each_entry(blk, &comp->blocks, list) {
+		list_for_each(pos, &blk->instrs->list) {
+			struct instr *ins = container_of(pos, struct instr, list);
 
-	list_for_each(pos, &comp->blocks) {
-		struct block *blk = container_of(pos, struct block, list);
+			if (!instr_is_live(ins) || ins->code != (BPF_LDX | BPF_MEM) ||
+					!(live_regs & (1 << ins->k)))
+				continue;
 
-		optimize_block(blk);
+			/* only one of the offsets can live in X */
+			if (reg >= 0 && reg != ins->k)
+				return;
+			reg = ins->k;
+		}
+	}
+
+	if (reg < 0 || !hdr_x_is_kept(comp, reg))
+		return;
+
+	list_for_each_entry(blk, &comp->blocks, list) {
+		list_for_each(pos, &blk->instrs->list) {
+			struct instr *ins = container_of(pos, struct instr, list);
+
+			if (instr_is_live(ins) && instr_is_hdr_load(ins, reg))
+				instr_set_optimized(ins);
+		}
 	}
 }
 
+/* header offsets which are not reloaded anywhere need no store */
+static void optimize_hdr_stores(struct compiler *comp)
+{
+	uint32_t read_regs = 0;
+	struct list_head *pos;
+	struct block *blk;
+
+	list_for_each_entry(blk, &comp->blocks, list) {
+		list_for_each(pos, &blk->instrs->list) {
+			struct instr *ins = container_of(pos, struct instr, list);
+
+			if (instr_is_live(ins) && BPF_MODE(ins->code) == BPF_MEM &&
+					(BPF_CLASS(ins->code) == BPF_LD ||
+					 BPF_CLASS(ins->code) == BPF_LDX))
+				read_regs |= 1 << ins->k;
+		}
+	}
+
+	list_for_each_entry(blk, &comp->blocks, list) {
+		list_for_each(pos, &blk->instrs->list) {
+			struct instr *ins = container_of(pos, struct instr, list);
+
+			if (!instr_is_live(ins) ||
+					(ins->code != BPF_ST && ins->code != BPF_STX))
+				continue;
+
+			if ((live_regs & (1 << ins->k)) &&
+					!(read_regs & (1 << ins->k)))
+				instr_set_optimized(ins);
+		}
+	}
+}
+
+/* values a single block can number: 3 per instruction and the registers */
+static int blocks_max_values(struct compiler *comp)
+{
+	struct list_head *pos;
+	struct block *blk;
+	int max = 0;
+
+	list_for_each_entry(blk, &comp->blocks, list) {
+		int count = 1;
+
+		list_for_each(pos, &blk->instrs->list)
+			count++;
+
+		if (count > max)
+			max = count;
+	}
+
+	return max * 3 + REGS_MAX + 1;
+}
+
 static void optimize_init(void)
 {
-	values = xmalloc(max_values * 3 * sizeof(struct value));
-	value_instrs_new = value_instrs = xmalloc(max_values * 3 *
+	values = xmalloc(max_values * sizeof(struct value));
+	value_instrs_new = value_instrs = xmalloc(max_values *
 			sizeof(struct value_instr));
-	instrs = htable_alloc(INSTR_HTABLE_SIZE);
+	instrs = htable_alloc(INSTR_HTABLE_SIZE, value_instr_eq);
 }
 
 static void optimize_uninit(void)
@@ -489,18 +729,35 @@ static void optimize_uninit(void)
 	htable_free(instrs);
 }
 
+static void optimize_stats(void)
+{
+	struct compiler_stats *stats = stats_current();
+
+	if (!stats)
+		return;
+
+	stats->opt_iterations = iterations;
+	stats->instrs_removed_fold = removed_fold;
+	stats->instrs_removed_dead = removed_dead;
+}
+
 int optimize(struct compiler *comp)
 {
-	max_values = instr_count = comp->instr_count;
+	instr_count = comp->instr_count;
+	iterations = removed_fold = removed_dead = 0;
+	live_regs = comp->hdr_regs;
+
+	/* registers start each block with a value of their own */
+	max_values = blocks_max_values(comp);
 
 	optimize_init();
+	optimize_blocks(comp);
 
-	do {
-		is_code_modified = false;
-		optimize_blocks(comp);
-	} while (is_code_modified);
+	optimize_hdr_x(comp);
+	optimize_hdr_stores(comp);
 
 	optimize_uninit();
+	optimize_stats();
 
 	return instr_count;
 }
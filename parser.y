@@ -10,18 +10,41 @@
  */
 
 %error-verbose
+%locations
 
 %{
 
 #include <stdio.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
+#include "stats.h"
 #include "compiler.h"
 
+/* accounts the time spent in code generation actions */
+#define CODEGEN(action) do {				\
+	uint64_t __start = stats_timer_start();		\
+	action;						\
+	stats_timer_stop(STAGE_CODEGEN, __start);	\
+} while (0)
+
+/* blocks built by the action are attributed to the construct */
+#define SRC(loc)	src_loc_set((loc).first_line, (loc).first_column, \
+				    (loc).last_column)
+#define SRC_NONE	src_loc_set(0, 0, 0)
+
+/* parentheses are nested as deep as the filter asks for */
+#define YYMAXDEPTH	(1 << 20)
+
 void yyerror(const char *s, ...);
 void yy_scan_string(char *);
+void *yy_scan_buffer(char *, size_t);
+void yyrestart(FILE *);
 void yylex_destroy();
 int yylex(void);
 
@@ -66,13 +89,21 @@ static int offs_size_parse(char *s)
 	struct expr *exp;
 }
 
-%type <blk> stmt
+%type <blk> stmt rule rules
 %type <exp> expr
 
 %token <value> NUMBER
 %token <name> NAME
+%token <name> STRING
 %token <op> CMP
-%token LAND LOR
+%token LAND LOR ARROW ACCEPT DROP IF RETURN
+
+/*
+ * Rules have no end, so '[' after a rule which ends with a name goes on
+ * as its offset (name[...]). A next rule which starts with a packet offset
+ * needs it in parentheses: ([40]) == 1 -> 2.
+ */
+%expect 2
 
 %left LOR LAND
 %left CMP
@@ -81,37 +112,80 @@ static int offs_size_parse(char *s)
 %left '&'
 %left LSH RSH
 %left '+' '-'
-%left '*' '/'
+%left '*' '/' '%'
 
 %start filter
 
 %%
 filter:
-      | stmt			{ parse_finish($1); }
+      | stmt			{ SRC_NONE; CODEGEN(parse_finish($1)); }
+      | rules			{ int err;
+				  SRC_NONE; CODEGEN(err = parse_rules_finish($1));
+				  if (err) YYERROR; }
 ;
 
-stmt: expr CMP expr		{ $$ = branch_build($2, $1, $3); }
-   | stmt LAND stmt		{ $$ = branch_merge(OP_LAND, $1, $3); }
-   | stmt LOR stmt		{ $$ = branch_merge(OP_LOR, $1, $3); }
-   | expr			{ $$ = block_build($1); }
+/* the first rule which holds gives the return value */
+rules: rule
+   | rules rule			{ SRC(@2); CODEGEN($$ = rules_add($1, $2)); }
 ;
 
-expr: expr '+' expr		{ $$ = expr_add($1, $3); }
-   | expr '-' expr		{ $$ = expr_sub($1, $3); }
-   | expr '*' expr		{ $$ = expr_mul($1, $3); }
-   | expr '/' expr		{ $$ = expr_div($1, $3); }
-   | expr '&' expr		{ $$ = expr_and($1, $3); }
-   | expr '|' expr		{ $$ = expr_or($1, $3); }
-   | expr '^' expr		{ $$ = expr_xor($1, $3); }
-   | expr LSH expr		{ $$ = expr_lsh($1, $3); }
-   | expr RSH expr		{ $$ = expr_rsh($1, $3); }
+/* accepted packets are cut to the number of bytes (snap length) */
+rule: stmt ARROW NUMBER		{ SRC(@$); CODEGEN($$ = rule_build($1, $3)); }
+   | ACCEPT NUMBER IF stmt	{ SRC(@$); CODEGEN($$ = rule_build($4, $2)); }
+   | ACCEPT IF stmt		{ SRC(@$); CODEGEN($$ = rule_build($3, -1)); }
+   | DROP IF stmt		{ SRC(@$); CODEGEN($$ = rule_build($3, 0)); }
+   | ACCEPT NUMBER		{ SRC(@$); CODEGEN($$ = rule_always($2)); }
+   | DROP			{ SRC(@$); CODEGEN($$ = rule_always(0)); }
+   | RETURN expr IF stmt	{ SRC(@$); CODEGEN($$ = rule_return($4, $2));
+				  if (!$$) YYERROR; }
+   | RETURN expr		{ SRC(@$); CODEGEN($$ = rule_return(NULL, $2));
+				  if (!$$) YYERROR; }
+;
+
+stmt: expr CMP expr		{ SRC(@$); CODEGEN($$ = branch_build($2, $1, $3));
+				  if (!$$) YYERROR; }
+   | stmt LAND stmt		{ CODEGEN($$ = branch_merge(OP_LAND, $1, $3)); }
+   | stmt LOR stmt		{ CODEGEN($$ = branch_merge(OP_LOR, $1, $3)); }
+   | expr			{ SRC(@$); CODEGEN($$ = block_build($1));
+				  if (!$$) YYERROR; }
+   | NAME '[' NUMBER ':' NUMBER ']' CMP STRING
+				{ SRC(@$);
+				  CODEGEN($$ = pattern_build($1, $3, $5, $7, $8));
+				  if (!$$) YYERROR; }
+;
+
+expr: expr '+' expr		{ CODEGEN($$ = expr_add($1, $3));
+				  if (!$$) YYERROR; }
+   | expr '-' expr		{ CODEGEN($$ = expr_sub($1, $3));
+				  if (!$$) YYERROR; }
+   | expr '*' expr		{ CODEGEN($$ = expr_mul($1, $3));
+				  if (!$$) YYERROR; }
+   | expr '/' expr		{ CODEGEN($$ = expr_div($1, $3));
+				  if (!$$) YYERROR; }
+   | expr '%' expr		{ CODEGEN($$ = expr_mod($1, $3));
+				  if (!$$) YYERROR; }
+   | expr '&' expr		{ CODEGEN($$ = expr_and($1, $3));
+				  if (!$$) YYERROR; }
+   | expr '|' expr		{ CODEGEN($$ = expr_or($1, $3));
+				  if (!$$) YYERROR; }
+   | expr '^' expr		{ CODEGEN($$ = expr_xor($1, $3));
+				  if (!$$) YYERROR; }
+   | expr LSH expr		{ CODEGEN($$ = expr_lsh($1, $3));
+				  if (!$$) YYERROR; }
+   | expr RSH expr		{ CODEGEN($$ = expr_rsh($1, $3));
+				  if (!$$) YYERROR; }
    | '(' expr ')'		{ $$ = $2; }
-   | NUMBER			{ $$ = expr_number($1); }
-   | '[' expr ']'   		{ $$ = expr_offset($2, 1); }
-   | '[' expr ':' NUMBER ']'	{ $$ = expr_offset($2, $4); }
-   | '[' expr ':' NAME ']'	{ $$ = expr_offset($2, offs_size_parse($4)); }
-   | NAME '[' expr ']'  	{ $$ = expr_proto_offset($1, $3); }
-   | NAME			{ $$ = expr_proto($1); }
+   | NUMBER			{ CODEGEN($$ = expr_number($1)); }
+   | '[' expr ']'   		{ CODEGEN($$ = expr_offset($2, 1));
+				  if (!$$) YYERROR; }
+   | '[' expr ':' NUMBER ']'	{ CODEGEN($$ = expr_offset($2, $4));
+				  if (!$$) YYERROR; }
+   | '[' expr ':' NAME ']'	{ CODEGEN($$ = expr_offset($2, offs_size_parse($4)));
+				  if (!$$) YYERROR; }
+   | NAME '[' expr ']'  	{ CODEGEN($$ = expr_proto_offset($1, $3));
+				  if (!$$) YYERROR; }
+   | NAME			{ CODEGEN($$ = expr_proto($1));
+				  if (!$$) YYERROR; }
 ;
 
 %%
@@ -124,13 +198,103 @@ void yyerror(const char *s, ...)
 	fprintf(stderr, "error: ");
 	vfprintf(stderr, s, ap);
 	fprintf(stderr, "\n");
-
-	exit(EXIT_FAILURE);
+	va_end(ap);
 }
 
-void parse_filter(char *s)
+int parse_filter(char *s)
 {
+	int ret;
+
+	src_text_set(s);
 	yy_scan_string(s);
-	yyparse();
+	ret = yyparse();
 	yylex_destroy();
+
+	return ret ? -1 : 0;
+}
+
+static int parse_stream(FILE *fp)
+{
+	int ret;
+
+	src_text_set(NULL);
+	yyrestart(fp);
+	ret = yyparse();
+	yylex_destroy();
+
+	return ret ? -1 : 0;
+}
+
+/*
+ * The scanner needs two NUL bytes after the text, so the file is mapped
+ * over an anonymous mapping which is 2 bytes longer. The mapping is
+ * private and writable as the scanner terminates tokens in place.
+ */
+static char *file_map(int fd, size_t size, size_t *map_len)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	char *buf;
+
+	*map_len = (size + 2 + page_size - 1) & ~(page_size - 1);
+
+	buf = mmap(NULL, *map_len, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED)
+		return NULL;
+
+	if (mmap(buf, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+				fd, 0) == MAP_FAILED) {
+		munmap(buf, *map_len);
+		return NULL;
+	}
+
+	return buf;
+}
+
+int parse_file(char *path)
+{
+	size_t map_len;
+	struct stat st;
+	char *buf;
+	FILE *fp;
+	int ret;
+	int fd;
+
+	if (strcmp(path, "-") == 0)
+		return parse_stream(stdin);
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "error: can't open %s\n", path);
+		return -1;
+	}
+	if (fstat(fd, &st)) {
+		fprintf(stderr, "error: can't open %s\n", path);
+		close(fd);
+		return -1;
+	}
+
+	/* pipes and the like are read through the scanner buffer */
+	if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+		fp = fdopen(fd, "r");
+		ret = parse_stream(fp);
+		fclose(fp);
+		return ret;
+	}
+
+	buf = file_map(fd, st.st_size, &map_len);
+	close(fd);
+	if (!buf) {
+		fprintf(stderr, "error: can't map %s\n", path);
+		return -1;
+	}
+
+	/* the text is unmapped before the code is emitted */
+	src_text_set(NULL);
+	yy_scan_buffer(buf, st.st_size + 2);
+	ret = yyparse();
+	yylex_destroy();
+
+	munmap(buf, map_len);
+	return ret ? -1 : 0;
 }
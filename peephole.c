@@ -0,0 +1,1062 @@
+/*
+ * peephole.c	replacements of short instruction windows
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * Authors:	Vadim Kochan <vadim4j@gmail.com>
+ */
+
+/*
+ * Runs after the optimizer over the instructions each block kept. The
+ * table maps windows of 2 to 4 instructions to shorter ones which leave
+ * the same A, take the same jump and keep the M[] registers and X which
+ * are read after the window. The windows are the ones expressions leave:
+ * an operand kept in a temporary M[] to be loaded to X for the operation,
+ * which the value numbering cannot drop as the value is really used.
+ *
+ * Rules are written over the operands: the M[] registers, the operation
+ * and the instructions in between are bound by the match. peephole_check()
+ * runs every rule against an interpreter on random registers and packets
+ * and enumerates the sequences shorter than its replacement, so a rule
+ * which is wrong or not the shortest one is reported.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bpf.h"
+#include "stats.h"
+#include "xmalloc.h"
+#include "peephole.h"
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+
+#define PP_WINDOW_MAX	4
+
+/* registers as bits: the M[] ones, then A and X */
+#define PP_M(k)		(1U << (k))
+#define PP_A		(1U << REG_A)
+#define PP_X		(1U << (REG_X))
+
+/* M[] operands of a rule, a match binds them to different registers */
+enum {
+	PP_NONE,
+	PP_MA,
+	PP_MB,
+	PP_MEM_MAX,
+};
+
+enum {
+	/* the code, on the M[] operand if it has one */
+	PP_CODE,
+	/* alu operation or conditional jump on A and X */
+	PP_OP_X,
+	/* the alu ones which give the same with A and X swapped */
+	PP_COMM_X,
+	/* the conditional jumps which do */
+	PP_COMM_JMP,
+	/* does not jump and touches neither X nor the M[] operands */
+	PP_OTHER,
+};
+
+struct pp_insn {
+	int type;
+	uint16_t code;
+	int mem;
+};
+
+/* copy of the matched instruction (index + 1) or the code */
+struct pp_repl {
+	int copy;
+	uint16_t code;
+	int mem;
+};
+
+/* registers which are not read after the window */
+#define PP_DEAD_MA	(1 << 0)
+#define PP_DEAD_MB	(1 << 1)
+#define PP_DEAD_X	(1 << 2)
+#define PP_DEAD_A	(1 << 3)
+
+struct pp_rule {
+	const char *name;
+	int len;
+	struct pp_insn match[PP_WINDOW_MAX];
+	int repl_len;
+	struct pp_repl repl[PP_WINDOW_MAX];
+	int dead;
+};
+
+#define INSN(c, m)	{ PP_CODE, (c), (m) }
+#define OP_X		{ PP_OP_X }
+#define COMM_X		{ PP_COMM_X }
+#define COMM_JMP	{ PP_COMM_JMP }
+#define OTHER		{ PP_OTHER }
+
+#define COPY(i)		{ (i) + 1 }
+#define NEW(c, m)	{ 0, (c), (m) }
+
+#define ST(m)		INSN(BPF_ST, m)
+#define STX(m)		INSN(BPF_STX, m)
+#define LD(m)		INSN(BPF_LD | BPF_MEM, m)
+#define LDX(m)		INSN(BPF_LDX | BPF_MEM, m)
+#define TAX		INSN(BPF_MISC | BPF_TAX, PP_NONE)
+#define TXA		INSN(BPF_MISC | BPF_TXA, PP_NONE)
+
+/* longer windows first, a match is replaced by the first rule */
+static struct pp_rule pp_rules[] = {
+	{
+		/* the right operand is stored while the left one is loaded */
+		.name		= "operand-tax",
+		.len		= 4,
+		.match		= { ST(PP_MB), LD(PP_MA), LDX(PP_MB), OP_X },
+		.repl_len	= 3,
+		.repl		= { NEW(BPF_MISC | BPF_TAX, PP_NONE), COPY(1),
+				    COPY(3) },
+		.dead		= PP_DEAD_MB,
+	},
+	{
+		/* the left operand is stored while the right one is computed */
+		.name		= "spill-tax-2",
+		.len		= 4,
+		.match		= { ST(PP_MA), OTHER, OTHER, LDX(PP_MA) },
+		.repl_len	= 3,
+		.repl		= { NEW(BPF_MISC | BPF_TAX, PP_NONE), COPY(1),
+				    COPY(2) },
+		.dead		= PP_DEAD_MA,
+	},
+	{
+		.name		= "spill-tax-1",
+		.len		= 3,
+		.match		= { ST(PP_MA), OTHER, LDX(PP_MA) },
+		.repl_len	= 2,
+		.repl		= { NEW(BPF_MISC | BPF_TAX, PP_NONE), COPY(1) },
+		.dead		= PP_DEAD_MA,
+	},
+	{
+		/* A and X swapped for an operation which does not mind */
+		.name		= "commute",
+		.len		= 3,
+		.match		= { TAX, LD(PP_MA), COMM_X },
+		.repl_len	= 2,
+		.repl		= { NEW(BPF_LDX | BPF_MEM, PP_MA), COPY(2) },
+		.dead		= PP_DEAD_X,
+	},
+	{
+		/* the jump leaves A, which is not read after the block */
+		.name		= "commute-jmp",
+		.len		= 3,
+		.match		= { TAX, LD(PP_MA), COMM_JMP },
+		.repl_len	= 2,
+		.repl		= { NEW(BPF_LDX | BPF_MEM, PP_MA), COPY(2) },
+		.dead		= PP_DEAD_X | PP_DEAD_A,
+	},
+	{
+		.name		= "store-tax",
+		.len		= 2,
+		.match		= { ST(PP_MA), LDX(PP_MA) },
+		.repl_len	= 1,
+		.repl		= { NEW(BPF_MISC | BPF_TAX, PP_NONE) },
+		.dead		= PP_DEAD_MA,
+	},
+	{
+		.name		= "store-reload",
+		.len		= 2,
+		.match		= { ST(PP_MA), LD(PP_MA) },
+		.repl_len	= 1,
+		.repl		= { COPY(0) },
+	},
+	{
+		.name		= "load-store",
+		.len		= 2,
+		.match		= { LD(PP_MA), ST(PP_MA) },
+		.repl_len	= 1,
+		.repl		= { COPY(0) },
+	},
+	{
+		.name		= "storex-reload",
+		.len		= 2,
+		.match		= { STX(PP_MA), LDX(PP_MA) },
+		.repl_len	= 1,
+		.repl		= { COPY(0) },
+	},
+	{
+		.name		= "loadx-store",
+		.len		= 2,
+		.match		= { LDX(PP_MA), STX(PP_MA) },
+		.repl_len	= 1,
+		.repl		= { COPY(0) },
+	},
+	{
+		.name		= "tax-txa",
+		.len		= 2,
+		.match		= { TAX, TXA },
+		.repl_len	= 1,
+		.repl		= { COPY(0) },
+	},
+	{
+		.name		= "txa-tax",
+		.len		= 2,
+		.match		= { TXA, TAX },
+		.repl_len	= 1,
+		.repl		= { COPY(0) },
+	},
+};
+
+static int instr_count;
+/* registers read by the next blocks */
+static uint32_t live_out;
+
+/* live instructions of the block and the registers live after each */
+static struct instr **window;
+static uint32_t *live_after;
+
+static void pp_regs(uint16_t code, uint32_t k, uint32_t *use, uint32_t *def)
+{
+	uint32_t mem = k < REGS_MEM_MAX ? PP_M(k) : 0;
+
+	*use = *def = 0;
+
+	switch (BPF_CLASS(code)) {
+	case BPF_RET:
+		if (BPF_RVAL(code) == BPF_A)
+			*use = PP_A;
+		else if (BPF_RVAL(code) == BPF_X)
+			*use = PP_X;
+		break;
+
+	case BPF_LD:
+	case BPF_LDX:
+		*def = BPF_CLASS(code) == BPF_LD ? PP_A : PP_X;
+
+		if (BPF_MODE(code) == BPF_IND)
+			*use = PP_X;
+		else if (BPF_MODE(code) == BPF_MEM)
+			*use = mem;
+		break;
+
+	case BPF_ST:
+		*use = PP_A;
+		*def = mem;
+		break;
+	case BPF_STX:
+		*use = PP_X;
+		*def = mem;
+		break;
+
+	case BPF_ALU:
+		*def = PP_A;
+		*use = PP_A | (BPF_SRC(code) == BPF_X ? PP_X : 0);
+		break;
+	case BPF_JMP:
+		if (BPF_OP(code) != BPF_JA)
+			*use = PP_A | (BPF_SRC(code) == BPF_X ? PP_X : 0);
+		break;
+
+	case BPF_MISC:
+		if (BPF_MISCOP(code) == BPF_TAX) {
+			*use = PP_A;
+			*def = PP_X;
+		} else {
+			*use = PP_X;
+			*def = PP_A;
+		}
+		break;
+	}
+}
+
+static bool pp_is_jmp(uint16_t code)
+{
+	return BPF_CLASS(code) == BPF_JMP || BPF_CLASS(code) == BPF_RET;
+}
+
+static bool pp_is_op_x(uint16_t code)
+{
+	if (BPF_SRC(code) != BPF_X)
+		return false;
+
+	if (BPF_CLASS(code) == BPF_ALU)
+		return BPF_OP(code) != BPF_NEG;
+
+	return BPF_CLASS(code) == BPF_JMP && BPF_OP(code) != BPF_JA;
+}
+
+static bool pp_is_comm_x(uint16_t code)
+{
+	int op = BPF_OP(code);
+
+	if (!pp_is_op_x(code) || BPF_CLASS(code) != BPF_ALU)
+		return false;
+
+	return op == BPF_ADD || op == BPF_MUL || op == BPF_AND ||
+		op == BPF_OR || op == BPF_XOR;
+}
+
+static bool pp_is_comm_jmp(uint16_t code)
+{
+	int op = BPF_OP(code);
+
+	if (!pp_is_op_x(code) || BPF_CLASS(code) != BPF_JMP)
+		return false;
+
+	return op == BPF_JEQ || op == BPF_JSET;
+}
+
+static bool pp_is_other(struct sock_filter *f, int mem[])
+{
+	uint32_t use, def;
+	uint32_t mask = PP_X;
+	int i;
+
+	if (pp_is_jmp(f->code))
+		return false;
+
+	for (i = PP_MA; i < PP_MEM_MAX; i++)
+		if (mem[i] >= 0)
+			mask |= PP_M(mem[i]);
+
+	pp_regs(f->code, f->k, &use, &def);
+	return !((use | def) & mask);
+}
+
+static bool pp_bind(int mem[], int var, uint32_t k)
+{
+	int i;
+
+	if (k >= REGS_MEM_MAX)
+		return false;
+	if (mem[var] >= 0)
+		return mem[var] == (int)k;
+
+	for (i = PP_MA; i < PP_MEM_MAX; i++)
+		if (mem[i] == (int)k)
+			return false;
+
+	mem[var] = k;
+	return true;
+}
+
+static bool pp_match(struct pp_rule *rule, struct sock_filter *win, int mem[])
+{
+	int i;
+
+	for (i = 0; i < PP_MEM_MAX; i++)
+		mem[i] = -1;
+
+	for (i = 0; i < rule->len; i++) {
+		struct pp_insn *m = &rule->match[i];
+
+		switch (m->type) {
+		case PP_CODE:
+			if (win[i].code != m->code)
+				return false;
+			if (m->mem != PP_NONE && !pp_bind(mem, m->mem, win[i].k))
+				return false;
+			break;
+		case PP_OP_X:
+			if (!pp_is_op_x(win[i].code))
+				return false;
+			break;
+		case PP_COMM_X:
+			if (!pp_is_comm_x(win[i].code))
+				return false;
+			break;
+		case PP_COMM_JMP:
+			if (!pp_is_comm_jmp(win[i].code))
+				return false;
+			break;
+		}
+	}
+
+	/* the operands are bound by now */
+	for (i = 0; i < rule->len; i++)
+		if (rule->match[i].type == PP_OTHER &&
+				!pp_is_other(&win[i], mem))
+			return false;
+
+	return true;
+}
+
+static bool pp_is_dead(struct pp_rule *rule, int mem[], uint32_t live)
+{
+	if ((rule->dead & PP_DEAD_MA) && (live & PP_M(mem[PP_MA])))
+		return false;
+	if ((rule->dead & PP_DEAD_MB) && (live & PP_M(mem[PP_MB])))
+		return false;
+	if ((rule->dead & PP_DEAD_X) && (live & PP_X))
+		return false;
+	if ((rule->dead & PP_DEAD_A) && (live & PP_A))
+		return false;
+
+	return true;
+}
+
+/* instructions of the sequence with the operands the match bound */
+static void pp_build(struct pp_repl *seq, int len, struct sock_filter *win,
+		int mem[], struct sock_filter *code)
+{
+	int i;
+
+	for (i = 0; i < len; i++) {
+		struct pp_repl *r = &seq[i];
+
+		if (r->copy) {
+			code[i] = win[r->copy - 1];
+			continue;
+		}
+
+		code[i].code = r->code;
+		code[i].jt = code[i].jf = 0;
+		code[i].k = r->mem != PP_NONE ? mem[r->mem] : 0;
+	}
+}
+
+static void instr_set(struct instr *ins, struct sock_filter *f)
+{
+	ins->code = f->code;
+	ins->k = f->k;
+}
+
+/*
+ * The last instruction of the window gets the last one of the replacement,
+ * so the jump of the block stays the jump.
+ */
+static void pp_apply(struct pp_rule *rule, struct instr **ins,
+		struct sock_filter *repl)
+{
+	int last = rule->len - 1;
+	int i;
+
+	for (i = 0; i < rule->repl_len - 1; i++)
+		instr_set(ins[i], &repl[i]);
+
+	for (; i < last; i++) {
+		ins[i]->is_optimized = true;
+		instr_count--;
+	}
+
+	instr_set(ins[last], &repl[rule->repl_len - 1]);
+}
+
+static int block_window(struct block *blk)
+{
+	struct list_head *pos;
+	int count = 0;
+
+	list_for_each(pos, &blk->instrs->list) {
+		struct instr *ins = container_of(pos, struct instr, list);
+
+		if (!ins->is_optimized)
+			window[count++] = ins;
+	}
+
+	if (blk->jmp_instr && !blk->jmp_instr->is_optimized)
+		window[count++] = blk->jmp_instr;
+
+	return count;
+}
+
+/* temporary M[] registers are dead at the end of the block */
+static void block_liveness(int count)
+{
+	uint32_t live = live_out;
+	uint32_t use, def;
+	int i;
+
+	for (i = count - 1; i >= 0; i--) {
+		live_after[i] = live;
+
+		pp_regs(window[i]->code, window[i]->k, &use, &def);
+		live = (live & ~def) | use;
+	}
+}
+
+/* one pass over the block, the windows replaced are not looked at again */
+static bool peephole_block(struct block *blk)
+{
+	struct sock_filter win[PP_WINDOW_MAX];
+	struct sock_filter repl[PP_WINDOW_MAX];
+	bool is_modified = false;
+	int mem[PP_MEM_MAX];
+	int count, i, j;
+	size_t r;
+
+	count = block_window(blk);
+	block_liveness(count);
+
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < PP_WINDOW_MAX && i + j < count; j++) {
+			win[j].code = window[i + j]->code;
+			win[j].k = window[i + j]->k;
+			win[j].jt = win[j].jf = 0;
+		}
+
+		for (r = 0; r < ARRAY_SIZE(pp_rules); r++) {
+			struct pp_rule *rule = &pp_rules[r];
+
+			if (i + rule->len > count || !pp_match(rule, win, mem) ||
+					!pp_is_dead(rule, mem,
+						live_after[i + rule->len - 1]))
+				continue;
+
+			pp_build(rule->repl, rule->repl_len, win, mem, repl);
+			pp_apply(rule, &window[i], repl);
+
+			is_modified = true;
+			i += rule->len - 1;
+			break;
+		}
+	}
+
+	return is_modified;
+}
+
+/* A or X is kept across blocks if a block reads it before it writes it */
+static uint32_t regs_live_in(struct compiler *comp)
+{
+	uint32_t live = 0;
+	struct block *blk;
+	uint32_t use, def;
+	int count, i;
+
+	list_for_each_entry(blk, &comp->blocks, list) {
+		uint32_t written = 0;
+
+		count = block_window(blk);
+
+		for (i = 0; i < count; i++) {
+			pp_regs(window[i]->code, window[i]->k, &use, &def);
+
+			live |= use & ~written & (PP_A | PP_X);
+			written |= def;
+		}
+	}
+
+	return live;
+}
+
+static int blocks_max_instrs(struct compiler *comp)
+{
+	struct list_head *pos;
+	struct block *blk;
+	int max = 0;
+
+	list_for_each_entry(blk, &comp->blocks, list) {
+		int count = 1;
+
+		list_for_each(pos, &blk->instrs->list)
+			count++;
+
+		if (count > max)
+			max = count;
+	}
+
+	return max;
+}
+
+int peephole(struct compiler *comp)
+{
+	struct compiler_stats *stats = stats_current();
+	struct block *blk;
+	int max;
+
+	instr_count = comp->instr_count;
+
+	max = blocks_max_instrs(comp);
+	window = xmalloc(sizeof(struct instr *) * max);
+	live_after = xmalloc(sizeof(uint32_t) * max);
+
+	live_out = comp->hdr_regs | regs_live_in(comp);
+
+	list_for_each_entry(blk, &comp->blocks, list)
+		while (peephole_block(blk))
+			;
+
+	xfree(window);
+	xfree(live_after);
+
+	if (stats)
+		stats->instrs_removed_peephole = comp->instr_count - instr_count;
+
+	return instr_count;
+}
+
+/* the check runs the same random inputs through each sequence */
+#define PP_CHECK_SEED	1
+/* bindings of the operands tried per rule */
+#define PP_INSTANCES	256
+#define PP_TESTS	256
+#define PP_PKT_LEN	64
+#define PP_ALPHABET_MAX	16
+
+struct pp_state {
+	uint32_t a;
+	uint32_t x;
+	uint32_t mem[REGS_MEM_MAX];
+	bool is_taken;
+	bool is_aborted;
+};
+
+struct pp_input {
+	struct pp_state state;
+	uint8_t pkt[PP_PKT_LEN];
+};
+
+static struct pp_input *pp_inputs;
+
+static uint16_t pp_ops_x[] = {
+	BPF_ALU | BPF_X | BPF_ADD,	BPF_ALU | BPF_X | BPF_SUB,
+	BPF_ALU | BPF_X | BPF_MUL,	BPF_ALU | BPF_X | BPF_DIV,
+	BPF_ALU | BPF_X | BPF_MOD,	BPF_ALU | BPF_X | BPF_AND,
+	BPF_ALU | BPF_X | BPF_OR,	BPF_ALU | BPF_X | BPF_XOR,
+	BPF_ALU | BPF_X | BPF_LSH,	BPF_ALU | BPF_X | BPF_RSH,
+	BPF_JMP | BPF_X | BPF_JEQ,	BPF_JMP | BPF_X | BPF_JGT,
+	BPF_JMP | BPF_X | BPF_JGE,	BPF_JMP | BPF_X | BPF_JSET,
+};
+
+static uint16_t pp_ops_k[] = {
+	BPF_ADD, BPF_SUB, BPF_MUL, BPF_DIV, BPF_MOD, BPF_AND, BPF_OR,
+	BPF_XOR, BPF_LSH, BPF_RSH, BPF_NEG,
+};
+
+/* small values make the compares and masks go both ways */
+static uint32_t pp_rand_value(void)
+{
+	if (rand() % 2)
+		return rand() % 4;
+
+	return (uint32_t)rand() << 16 ^ rand();
+}
+
+static void pp_inputs_init(void)
+{
+	int i, j;
+
+	pp_inputs = xmalloc(sizeof(struct pp_input) * PP_TESTS);
+	memset(pp_inputs, 0, sizeof(struct pp_input) * PP_TESTS);
+
+	for (i = 0; i < PP_TESTS; i++) {
+		struct pp_input *in = &pp_inputs[i];
+
+		in->state.a = pp_rand_value();
+		in->state.x = pp_rand_value();
+		for (j = 0; j < REGS_MEM_MAX; j++)
+			in->state.mem[j] = pp_rand_value();
+		for (j = 0; j < PP_PKT_LEN; j++)
+			in->pkt[j] = rand() % 4 ? rand() : 0;
+	}
+}
+
+static uint32_t pp_alu(int op, uint32_t a, uint32_t v, bool *is_aborted)
+{
+	switch (op) {
+	case BPF_ADD:
+		return a + v;
+	case BPF_SUB:
+		return a - v;
+	case BPF_MUL:
+		return a * v;
+	case BPF_DIV:
+	case BPF_MOD:
+		/* the kernel drops the packet */
+		if (!v) {
+			*is_aborted = true;
+			return 0;
+		}
+		return op == BPF_DIV ? a / v : a % v;
+	case BPF_AND:
+		return a & v;
+	case BPF_OR:
+		return a | v;
+	case BPF_XOR:
+		return a ^ v;
+	case BPF_LSH:
+		return v < 32 ? a << v : 0;
+	case BPF_RSH:
+		return v < 32 ? a >> v : 0;
+	case BPF_NEG:
+		return -a;
+	}
+
+	return a;
+}
+
+static bool pp_cond(int op, uint32_t a, uint32_t v)
+{
+	switch (op) {
+	case BPF_JEQ:
+		return a == v;
+	case BPF_JGT:
+		return a > v;
+	case BPF_JGE:
+		return a >= v;
+	case BPF_JSET:
+		return a & v;
+	}
+
+	return true;
+}
+
+static uint32_t pp_load(struct sock_filter *f, struct pp_state *st,
+		uint8_t *pkt)
+{
+	int size = BPF_SIZE(f->code) == BPF_W ? 4 :
+		BPF_SIZE(f->code) == BPF_H ? 2 : 1;
+	uint32_t v = 0;
+	int i;
+
+	switch (BPF_MODE(f->code)) {
+	case BPF_IMM:
+		return f->k;
+	case BPF_LEN:
+		return PP_PKT_LEN;
+	case BPF_MEM:
+		return st->mem[f->k];
+	case BPF_MSH:
+		size = 1;
+		/* fall through */
+	case BPF_ABS:
+		if (f->k + size > PP_PKT_LEN) {
+			st->is_aborted = true;
+			return 0;
+		}
+
+		for (i = 0; i < size; i++)
+			v = v << 8 | pkt[f->k + i];
+
+		return BPF_MODE(f->code) == BPF_MSH ? 4 * (v & 0xf) : v;
+	}
+
+	st->is_aborted = true;
+	return 0;
+}
+
+static void pp_run(struct sock_filter *code, int len, struct pp_state *st,
+		uint8_t *pkt)
+{
+	int i;
+
+	for (i = 0; i < len && !st->is_aborted; i++) {
+		struct sock_filter *f = &code[i];
+		uint32_t v = BPF_SRC(f->code) == BPF_X ? st->x : f->k;
+
+		switch (BPF_CLASS(f->code)) {
+		case BPF_LD:
+			st->a = pp_load(f, st, pkt);
+			break;
+		case BPF_LDX:
+			st->x = pp_load(f, st, pkt);
+			break;
+		case BPF_ST:
+			st->mem[f->k] = st->a;
+			break;
+		case BPF_STX:
+			st->mem[f->k] = st->x;
+			break;
+		case BPF_ALU:
+			st->a = pp_alu(BPF_OP(f->code), st->a, v,
+					&st->is_aborted);
+			break;
+		case BPF_JMP:
+			st->is_taken = pp_cond(BPF_OP(f->code), st->a, v);
+			break;
+		case BPF_MISC:
+			if (BPF_MISCOP(f->code) == BPF_TAX)
+				st->x = st->a;
+			else
+				st->a = st->x;
+			break;
+		}
+	}
+}
+
+static bool pp_state_eq(struct pp_state *s, struct pp_state *t, int dead,
+		int mem[])
+{
+	int i;
+
+	if (s->is_aborted || t->is_aborted)
+		return s->is_aborted == t->is_aborted;
+
+	if (s->is_taken != t->is_taken)
+		return false;
+	if (!(dead & PP_DEAD_A) && s->a != t->a)
+		return false;
+	if (!(dead & PP_DEAD_X) && s->x != t->x)
+		return false;
+
+	for (i = 0; i < REGS_MEM_MAX; i++) {
+		if ((dead & PP_DEAD_MA) && i == mem[PP_MA])
+			continue;
+		if ((dead & PP_DEAD_MB) && i == mem[PP_MB])
+			continue;
+		if (s->mem[i] != t->mem[i])
+			return false;
+	}
+
+	return true;
+}
+
+static bool pp_equal(struct sock_filter *code, int len,
+		struct sock_filter *other, int other_len, int dead, int mem[])
+{
+	int i;
+
+	for (i = 0; i < PP_TESTS; i++) {
+		struct pp_input *in = &pp_inputs[i];
+		struct pp_state s = in->state;
+		struct pp_state t = in->state;
+
+		pp_run(code, len, &s, in->pkt);
+		pp_run(other, other_len, &t, in->pkt);
+
+		if (!pp_state_eq(&s, &t, dead, mem))
+			return false;
+	}
+
+	return true;
+}
+
+static void pp_other(struct sock_filter *f, int mem[])
+{
+	static const int sizes[] = { BPF_W, BPF_H, BPF_B };
+	int op, reg;
+
+	memset(f, 0, sizeof(*f));
+
+	switch (rand() % 6) {
+	case 0:
+		f->code = BPF_LD | BPF_IMM;
+		f->k = pp_rand_value();
+		break;
+	case 1:
+		f->code = BPF_LD | BPF_ABS | sizes[rand() % 3];
+		f->k = rand() % (PP_PKT_LEN - 4);
+		break;
+	case 2:
+		f->code = BPF_LD | BPF_W | BPF_LEN;
+		break;
+	case 3:
+		op = pp_ops_k[rand() % ARRAY_SIZE(pp_ops_k)];
+		f->code = BPF_ALU | BPF_K | op;
+		if (op == BPF_DIV || op == BPF_MOD)
+			f->k = rand() % 7 + 1;
+		else
+			f->k = pp_rand_value();
+		break;
+	case 4:
+	case 5:
+		f->code = rand() % 2 ? BPF_ST : BPF_LD | BPF_MEM;
+		do {
+			reg = rand() % REGS_MEM_MAX;
+		} while (reg == mem[PP_MA] || reg == mem[PP_MB]);
+		f->k = reg;
+		break;
+	}
+}
+
+static void pp_instance(struct pp_rule *rule, int mem[],
+		struct sock_filter *win)
+{
+	int i;
+
+	mem[PP_NONE] = -1;
+	mem[PP_MA] = rand() % REGS_MEM_MAX;
+	do {
+		mem[PP_MB] = rand() % REGS_MEM_MAX;
+	} while (mem[PP_MB] == mem[PP_MA]);
+
+	for (i = 0; i < rule->len; i++) {
+		struct pp_insn *m = &rule->match[i];
+
+		memset(&win[i], 0, sizeof(win[i]));
+
+		switch (m->type) {
+		case PP_CODE:
+			win[i].code = m->code;
+			win[i].k = m->mem != PP_NONE ? mem[m->mem] : 0;
+			break;
+		case PP_OP_X:
+			win[i].code = pp_ops_x[rand() % ARRAY_SIZE(pp_ops_x)];
+			break;
+		case PP_COMM_X:
+			do {
+				win[i].code =
+					pp_ops_x[rand() % ARRAY_SIZE(pp_ops_x)];
+			} while (!pp_is_comm_x(win[i].code));
+			break;
+		case PP_COMM_JMP:
+			do {
+				win[i].code =
+					pp_ops_x[rand() % ARRAY_SIZE(pp_ops_x)];
+			} while (!pp_is_comm_jmp(win[i].code));
+			break;
+		case PP_OTHER:
+			pp_other(&win[i], mem);
+			break;
+		}
+	}
+}
+
+static bool pp_is_op_type(int type)
+{
+	return type == PP_OP_X || type == PP_COMM_X || type == PP_COMM_JMP;
+}
+
+/*
+ * Instructions a shorter sequence is made of: the ones the window has
+ * besides the moves, and the moves between A, X and the M[] operands.
+ * The operation stays last, so it is not one of them.
+ */
+static int pp_alphabet(struct pp_rule *rule, struct pp_repl *alpha)
+{
+	static const uint16_t moves[] = {
+		BPF_LD | BPF_MEM, BPF_LDX | BPF_MEM, BPF_ST, BPF_STX,
+	};
+	int count = 0;
+	size_t j;
+	int i;
+
+	memset(alpha, 0, sizeof(struct pp_repl) * PP_ALPHABET_MAX);
+
+	for (i = PP_MA; i < PP_MEM_MAX; i++) {
+		for (j = 0; j < ARRAY_SIZE(moves); j++) {
+			alpha[count].code = moves[j];
+			alpha[count++].mem = i;
+		}
+	}
+
+	alpha[count++].code = BPF_MISC | BPF_TAX;
+	alpha[count++].code = BPF_MISC | BPF_TXA;
+
+	for (i = 0; i < rule->len; i++)
+		if (rule->match[i].type == PP_OTHER)
+			alpha[count++].copy = i + 1;
+
+	return count;
+}
+
+/* the sequence does what the window does for all the bindings */
+static bool pp_seq_equal(struct pp_rule *rule, struct pp_repl *seq, int len,
+		struct sock_filter (*wins)[PP_WINDOW_MAX],
+		int (*mems)[PP_MEM_MAX], int count)
+{
+	struct sock_filter code[PP_WINDOW_MAX];
+	int n;
+
+	for (n = 0; n < count; n++) {
+		pp_build(seq, len, wins[n], mems[n], code);
+
+		if (!pp_equal(wins[n], rule->len, code, len, rule->dead,
+					mems[n]))
+			return false;
+	}
+
+	return true;
+}
+
+/* tries all the sequences shorter than the replacement */
+static bool pp_shorter(struct pp_rule *rule,
+		struct sock_filter (*wins)[PP_WINDOW_MAX],
+		int (*mems)[PP_MEM_MAX], int count, struct pp_repl *found,
+		int *found_len)
+{
+	struct pp_repl alpha[PP_ALPHABET_MAX];
+	struct pp_repl seq[PP_WINDOW_MAX];
+	int idx[PP_WINDOW_MAX];
+	int alpha_count = pp_alphabet(rule, alpha);
+	int last = rule->len - 1;
+	int fixed = pp_is_op_type(rule->match[last].type) ? 1 : 0;
+	int len, i;
+
+	for (len = 0; len + fixed < rule->repl_len; len++) {
+		memset(idx, 0, sizeof(idx));
+
+		for (;;) {
+			for (i = 0; i < len; i++)
+				seq[i] = alpha[idx[i]];
+			if (fixed) {
+				memset(&seq[len], 0, sizeof(seq[len]));
+				seq[len].copy = last + 1;
+			}
+
+			if (pp_seq_equal(rule, seq, len + fixed, wins, mems,
+						count)) {
+				memcpy(found, seq, sizeof(seq));
+				*found_len = len + fixed;
+				return true;
+			}
+
+			for (i = 0; i < len && ++idx[i] == alpha_count; i++)
+				idx[i] = 0;
+			if (i == len)
+				break;
+		}
+	}
+
+	return false;
+}
+
+static bool pp_rule_check(struct pp_rule *rule)
+{
+	struct sock_filter wins[PP_INSTANCES][PP_WINDOW_MAX];
+	int mems[PP_INSTANCES][PP_MEM_MAX];
+	struct sock_filter repl[PP_WINDOW_MAX];
+	struct pp_repl found[PP_WINDOW_MAX];
+	int bound[PP_MEM_MAX];
+	const char *err = NULL;
+	int found_len;
+	int n;
+
+	for (n = 0; n < PP_INSTANCES && !err; n++) {
+		pp_instance(rule, mems[n], wins[n]);
+		pp_build(rule->repl, rule->repl_len, wins[n], mems[n], repl);
+
+		if (!pp_match(rule, wins[n], bound))
+			err = "window is not matched";
+		else if (!pp_equal(wins[n], rule->len, repl, rule->repl_len,
+					rule->dead, mems[n]))
+			err = "replacement differs";
+	}
+
+	if (!err && pp_shorter(rule, wins, mems, PP_INSTANCES, found,
+				&found_len)) {
+		err = "shorter sequence";
+		n = 1;
+		pp_build(found, found_len, wins[0], mems[0], repl);
+	} else {
+		found_len = rule->repl_len;
+	}
+
+	printf("%-16s %d -> %d  %s\n", rule->name, rule->len, rule->repl_len,
+			err ? err : "ok");
+	if (!err)
+		return true;
+
+	printf("window:\n");
+	bpf_dump(wins[n - 1], rule->len);
+	printf("replacement:\n");
+	bpf_dump(repl, found_len);
+
+	return false;
+}
+
+int peephole_check(void)
+{
+	int failed = 0;
+	size_t i;
+
+	srand(PP_CHECK_SEED);
+	pp_inputs_init();
+
+	for (i = 0; i < ARRAY_SIZE(pp_rules); i++)
+		if (!pp_rule_check(&pp_rules[i]))
+			failed++;
+
+	xfree(pp_inputs);
+	return failed ? -1 : 0;
+}
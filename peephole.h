@@ -0,0 +1,9 @@
+#ifndef __PEEPHOLE_H__
+#define __PEEPHOLE_H__
+
+#include "compiler.h"
+
+int peephole(struct compiler *comp);
+int peephole_check(void);
+
+#endif
@@ -10,31 +10,103 @@
  */
 
 #include <stddef.h>
+#include <string.h>
+#include <stdint.h>
 
 #include "utils.h"
 #include "proto.h"
 #include "htable.h"
+#include "xmalloc.h"
 
 #define PROTOS_HTABLE_SIZE	32
-#define FIELDS_HTABLE_SIZE	256
+#define FIELDS_MAX_DEF		64
+/* average number of fields per displacement bucket */
+#define FIELDS_PER_BUCKET	4
+#define FIELDS_DISP_MAX		(1 << 20)
+
+/*
+ * Fields are looked up by name for every field in the expression. Once all
+ * the protocols are registered the names are put into a minimal perfect
+ * hash (hash and displace): the first hash picks a bucket, the bucket's
+ * displacement seeds the second hash which gives the field its own slot.
+ * So the lookup is a single probe and a single compare.
+ */
+static struct proto_field **fields;
+static int fields_count;
+static int fields_max;
+
+static struct proto_field **fields_slots;
+static uint32_t *fields_disp;
+static int fields_buckets;
 
 static struct htable *protos;
-static struct htable *fields;
+
+static uint32_t field_hash(const char *name, uint32_t seed)
+{
+	uint32_t hash = 2166136261u ^ (seed * 0x9e3779b9);
+
+	while (*name) {
+		hash ^= (uint8_t)*name++;
+		hash *= 16777619;
+	}
+
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6b;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35;
+	hash ^= hash >> 16;
+
+	return hash;
+}
+
+static void field_add(struct proto_field *f)
+{
+	if (fields_count == fields_max) {
+		struct proto_field **old = fields;
+
+		fields_max = fields_max ? fields_max * 2 : FIELDS_MAX_DEF;
+		fields = xmalloc(sizeof(*fields) * fields_max);
+		if (old) {
+			memcpy(fields, old, sizeof(*fields) * fields_count);
+			xfree(old);
+		}
+	}
+
+	fields[fields_count++] = f;
+}
 
 static void __fields_register(struct proto *p, struct proto_field *f)
 {
 	for (; f->name; f++) {
 		f->proto = p;
-		htable_insert_name(fields, &f->hlist, f->name);
+		field_add(f);
 	}
 }
 
 void proto_register(struct proto *p)
 {
+	if (p->lower_name)
+		p->lower = proto_lookup(p->lower_name);
+
 	htable_insert_name(protos, &p->hlist, p->name);
 
 	if (p->fields)
 		__fields_register(p, p->fields);
+
+	if (p->next_name)
+		p->next = proto_field_lookup(p->next_name);
+	if (p->frag_name)
+		p->frag = proto_field_lookup(p->frag_name);
+	if (p->present_name)
+		p->present = proto_field_lookup(p->present_name);
+
+	if (p->encap.type_name)
+		p->encap.type_field = proto_field_lookup(p->encap.type_name);
+
+	if (p->demux_name)
+		p->demux = proto_field_lookup(p->demux_name);
+	else if (p->lower)
+		p->demux = p->lower->next;
 }
 
 struct proto *proto_lookup(char *name)
@@ -48,21 +120,163 @@ struct proto *proto_lookup(char *name)
 
 struct proto_field *proto_field_lookup(char *name)
 {
-	struct hentry *entry = htable_find_name(fields, name);
-	if (!entry)
+	struct proto_field *f;
+	uint32_t bucket;
+	int i;
+
+	/* still registering */
+	if (!fields_slots) {
+		for (i = fields_count - 1; i >= 0; i--) {
+			if (strcmp(fields[i]->name, name) == 0)
+				return fields[i];
+		}
+
+		return NULL;
+	}
+
+	bucket = field_hash(name, 0) % fields_buckets;
+	f = fields_slots[field_hash(name, fields_disp[bucket]) % fields_count];
+	if (!f || strcmp(f->name, name) != 0)
 		return NULL;
 
-	return container_of(entry, struct proto_field, hlist);
+	return f;
+}
+
+static void fields_slots_free(void)
+{
+	if (fields_slots)
+		xfree(fields_slots);
+	if (fields_disp)
+		xfree(fields_disp);
+
+	fields_slots = NULL;
+	fields_disp = NULL;
+}
+
+/* place the bucket's fields with the first displacement which fits them */
+static bool fields_bucket_place(int *members, int count, uint32_t *disp)
+{
+	int slots[count];
+	uint32_t d;
+	int i, j;
+
+	for (d = 1; d < FIELDS_DISP_MAX; d++) {
+		for (i = 0; i < count; i++) {
+			slots[i] = field_hash(fields[members[i]]->name, d) %
+				fields_count;
+			if (fields_slots[slots[i]])
+				break;
+			for (j = 0; j < i && slots[j] != slots[i]; j++)
+				;
+			if (j < i)
+				break;
+		}
+		if (i < count)
+			continue;
+
+		for (i = 0; i < count; i++)
+			fields_slots[slots[i]] = fields[members[i]];
+
+		*disp = d;
+		return true;
+	}
+
+	return false;
+}
+
+static bool fields_hash_build(int buckets)
+{
+	int *start = xmalloc(sizeof(int) * (buckets + 1));
+	int *members = xmalloc(sizeof(int) * fields_count);
+	int *order = xmalloc(sizeof(int) * buckets);
+	int *pos = xmalloc(sizeof(int) * buckets);
+	bool is_built = true;
+	int b, i, j;
+
+	fields_buckets = buckets;
+	fields_disp = xmalloc(sizeof(uint32_t) * buckets);
+	fields_slots = xmalloc(sizeof(*fields_slots) * fields_count);
+	memset(fields_slots, 0, sizeof(*fields_slots) * fields_count);
+
+	memset(start, 0, sizeof(int) * (buckets + 1));
+	for (i = 0; i < fields_count; i++)
+		start[field_hash(fields[i]->name, 0) % buckets + 1]++;
+	for (b = 0; b < buckets; b++) {
+		start[b + 1] += start[b];
+		pos[b] = start[b];
+		order[b] = b;
+		fields_disp[b] = 0;
+	}
+	for (i = 0; i < fields_count; i++)
+		members[pos[field_hash(fields[i]->name, 0) % buckets]++] = i;
+
+	/* the biggest buckets are the hardest to place, so they go first */
+	for (i = 1; i < buckets; i++) {
+		int cur = order[i];
+
+		for (j = i; j > 0 && start[order[j - 1] + 1] - start[order[j - 1]] <
+				start[cur + 1] - start[cur]; j--)
+			order[j] = order[j - 1];
+		order[j] = cur;
+	}
+
+	for (i = 0; i < buckets && is_built; i++) {
+		b = order[i];
+
+		if (start[b + 1] == start[b])
+			break;
+
+		is_built = fields_bucket_place(&members[start[b]],
+				start[b + 1] - start[b], &fields_disp[b]);
+	}
+
+	xfree(pos);
+	xfree(order);
+	xfree(members);
+	xfree(start);
+
+	if (!is_built)
+		fields_slots_free();
+
+	return is_built;
+}
+
+/* should be called after all the protocols are registered */
+void proto_fields_build(void)
+{
+	int buckets;
+
+	fields_slots_free();
+
+	if (!fields_count)
+		return;
+
+	/* on failure (duplicated names) lookups just stay linear */
+	buckets = (fields_count + FIELDS_PER_BUCKET - 1) / FIELDS_PER_BUCKET;
+	while (!fields_hash_build(buckets) && buckets < fields_count)
+		buckets *= 2;
+}
+
+static bool proto_name_eq(struct hentry *entry, const void *name)
+{
+	return strcmp(container_of(entry, struct proto, hlist)->name,
+			name) == 0;
 }
 
 void proto_init(void)
 {
-	protos = htable_alloc(PROTOS_HTABLE_SIZE);
-	fields = htable_alloc(FIELDS_HTABLE_SIZE);
+	protos = htable_alloc(PROTOS_HTABLE_SIZE, proto_name_eq);
 }
 
 void proto_cleanup(void)
 {
-	htable_free(fields);
+	fields_slots_free();
+	if (fields)
+		xfree(fields);
+
+	fields = NULL;
+	fields_count = 0;
+	fields_max = 0;
+
 	htable_free(protos);
 }
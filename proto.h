@@ -17,23 +17,112 @@ typedef enum {
 
 struct proto_field;
 
+/* variable header length: ((hdr[offset] & mask) >> ctz(mask)) * scale */
+struct proto_len {
+	int offset;
+	int mask;
+	int scale;
+};
+
+#define PROTO_TAG_IDS	4
+
+/* optional tags between the fixed header and its type field (802.1Q) */
+struct proto_tags {
+	int offset;	/* of the first tag */
+	int len;
+	int max;
+	int ids[PROTO_TAG_IDS];
+};
+
+#define PROTO_EXT_IDS	4
+#define PROTO_EXT_MAX	8
+
+/*
+ * Optional extension headers between the fixed header and the upper one,
+ * laid out as in IPv6: next header at 0, length at 1 in 8 octet units not
+ * counting the first 8. The fragment header keeps the fragment offset at 2.
+ */
+struct proto_ext {
+	int max;	/* headers walked at most */
+	/* ids[0] is always tested, zero ids after it are unused */
+	int ids[PROTO_EXT_IDS];
+	int frag_id;
+};
+
+#define PROTO_OPTS_FLAGS	4
+
+/* optional header parts of len octets each, one for every set flag (GRE) */
+struct proto_opts {
+	int offset;	/* of the 16 bit flags */
+	int len;
+	int flags[PROTO_OPTS_FLAGS];
+};
+
+typedef enum {
+	ENCAP_NONE,
+	/* ethernet frame follows the header */
+	ENCAP_ETHER,
+	/* type field tells the following protocol, ETH_P_TEB is ethernet */
+	ENCAP_TYPE,
+	/*
+	 * Stack of 4 octet labels, the bottom one has its bit 0 at 2 set.
+	 * The IP version of the following packet tells its protocol.
+	 */
+	ENCAP_LABELS,
+} encap_t;
+
+/* the header carries another packet, whose headers are the inner ones */
+struct proto_encap {
+	encap_t type;
+	char *type_name;
+	struct proto_field *type_field;
+	int max;	/* labels walked at most */
+};
+
 struct proto {
 	struct hentry hlist;
 	int layer;
 	char *name;
 	int id;
+	/* protocol this one is carried in */
+	char *lower_name;
+	struct proto *lower;
+	int hdr_len; /* in octets/bytes, fixed part of the header */
+	struct proto_len var_len;
+	struct proto_tags tags;
+	struct proto_ext ext;
+	struct proto_opts opts;
+	struct proto_encap encap;
+	/*
+	 * Inner headers start here: the first of the encapsulations which is
+	 * there is decoded once, which tells the offset and the protocol.
+	 */
+	struct proto **encaps;
+	/* header is the first tag of the lower protocol */
+	bool is_tag;
 	struct proto_field *fields;
-	/* gen_proto_match */
-	/* gen_proto_next */
+	/* field telling the upper protocol, matched against its id */
+	char *next_name;
+	struct proto_field *next;
+	/* field which is non zero when the upper header is not there */
+	char *frag_name;
+	struct proto_field *frag;
+	/* field which is non zero when the header is there */
+	char *present_name;
+	struct proto_field *present;
+	/* field of the lower protocol matched against id, lower->next if unset */
+	char *demux_name;
+	struct proto_field *demux;
 };
 
 struct proto_field {
-	struct hentry hlist;
 	struct proto *proto;
 	char *name;
 	int offset; /* in octets/bytes */
 	int mask;
 	int len;
+	/* field follows the protocol tags, its offset moves with them */
+	bool after_tags;
 };
 
 void proto_init(void);
@@ -42,5 +131,6 @@ void proto_cleanup();
 void proto_register(struct proto *proto);
 struct proto *proto_lookup(char *name);
 struct proto_field *proto_field_lookup(char *name);
+void proto_fields_build(void);
 
 #endif
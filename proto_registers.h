@@ -1,7 +1,21 @@
 #ifndef __PROTO_REGISTERS_H__
 #define __PROTO_REGISTERS_H__
 
+typedef enum {
+	VLAN_NONE,
+	/* tags are parsed in the packet */
+	VLAN_PACKET,
+	/* outer tag is stripped by the kernel to the ancillary data */
+	VLAN_ANCILLARY,
+} vlan_mode_t;
+
+void link_protos_vlan_mode(vlan_mode_t mode);
 void link_protos_register(void);
+int net_protos_ipv6_ext_depth(int depth);
 void net_protos_register(void);
+void trans_protos_register(void);
+void skb_protos_register(void);
+void tunnel_protos_register(void);
+void tunnel_protos_unregister(void);
 
 #endif
@@ -0,0 +1,357 @@
+/*
+ * proto_spec.c	protocols loaded from the specification files
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * Authors:	Vadim Kochan <vadim4j@gmail.com>
+ */
+
+/*
+ * A specification file describes protocols on top of the built-in ones,
+ * so adding a protocol does not need a rebuild:
+ *
+ *	# comment
+ *	proto NAME [lower=PROTO] [id=N] [len=N] [varlen=OFF:MASK:SCALE]
+ *		   [layer=link|network|transport|4|5] [demux=FIELD]
+ *		   [next=FIELD] [frag=FIELD] [present=FIELD]
+ *	field NAME OFFSET WIDTH [MASK]
+ *
+ * The fields follow their protocol and are named "PROTO.NAME", offsets
+ * are from the start of the header and the width is 1, 2 or 4 octets.
+ * The protocol is matched by comparing its id with the demux field of the
+ * lower protocol (lower's next field by default). Referenced protocols and
+ * fields should be defined before.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "list.h"
+#include "proto.h"
+#include "xmalloc.h"
+#include "proto_spec.h"
+
+#define SPEC_LINE_MAX	512
+#define SPEC_FIELDS_MAX	64
+
+struct spec_proto {
+	struct list_head list;
+	struct proto proto;
+};
+
+static LIST_HEAD(spec_protos);
+
+static const char *layer_names[LAYER_MAX] = {
+	[LAYER_LINK]		= "link",
+	[LAYER_NETWORK]		= "network",
+	[LAYER_TRANSPORT]	= "transport",
+	[LAYER_4]		= "4",
+	[LAYER_5]		= "5",
+};
+
+struct spec_ctx {
+	char *path;
+	int line;
+	struct spec_proto *sp;
+	struct proto_field fields[SPEC_FIELDS_MAX];
+	int fields_count;
+};
+
+static char *spec_strdup(char *str)
+{
+	char *dup = xmalloc(strlen(str) + 1);
+
+	strcpy(dup, str);
+	return dup;
+}
+
+static void spec_strfree(char *str)
+{
+	if (str)
+		xfree(str);
+}
+
+static void spec_error(struct spec_ctx *ctx, const char *msg, char *arg)
+{
+	fprintf(stderr, "%s:%d: error: %s '%s'\n", ctx->path, ctx->line, msg,
+			arg);
+}
+
+static int spec_number(char *str, int *val)
+{
+	char *end;
+
+	*val = strtol(str, &end, 0);
+	return (*str && !*end) ? 0 : -1;
+}
+
+static void spec_proto_free(struct spec_proto *sp)
+{
+	struct proto *p = &sp->proto;
+	struct proto_field *f;
+
+	if (p->fields) {
+		for (f = p->fields; f->name; f++)
+			xfree(f->name);
+		xfree(p->fields);
+	}
+
+	spec_strfree(p->lower_name);
+	spec_strfree(p->next_name);
+	spec_strfree(p->frag_name);
+	spec_strfree(p->present_name);
+	spec_strfree(p->demux_name);
+	xfree(p->name);
+	xfree(sp);
+}
+
+static int spec_field_check(struct spec_ctx *ctx, char *name)
+{
+	if (name && !proto_field_lookup(name)) {
+		spec_error(ctx, "unknown field", name);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int spec_proto_finish(struct spec_ctx *ctx)
+{
+	struct spec_proto *sp = ctx->sp;
+	struct proto *p;
+	int size;
+
+	if (!sp)
+		return 0;
+
+	ctx->sp = NULL;
+	p = &sp->proto;
+
+	size = sizeof(struct proto_field) * (ctx->fields_count + 1);
+	p->fields = xmalloc(size);
+	memset(p->fields, 0, size);
+	memcpy(p->fields, ctx->fields,
+			sizeof(struct proto_field) * ctx->fields_count);
+	ctx->fields_count = 0;
+
+	if (p->lower_name && !proto_lookup(p->lower_name)) {
+		spec_error(ctx, "unknown lower protocol", p->lower_name);
+		spec_proto_free(sp);
+		return -1;
+	}
+
+	proto_register(p);
+	list_add_tail(&sp->list, &spec_protos);
+
+	/* may refer to the own fields, so checked after the registering */
+	if (spec_field_check(ctx, p->next_name) ||
+			spec_field_check(ctx, p->frag_name) ||
+			spec_field_check(ctx, p->present_name) ||
+			spec_field_check(ctx, p->demux_name))
+		return -1;
+
+	return 0;
+}
+
+static int spec_proto_attr(struct spec_ctx *ctx, struct proto *p, char *attr)
+{
+	char *val = strchr(attr, '=');
+	int i;
+
+	if (!val) {
+		spec_error(ctx, "wrong attribute", attr);
+		return -1;
+	}
+	*val++ = '\0';
+
+	if (strcmp(attr, "lower") == 0) {
+		p->lower_name = spec_strdup(val);
+	} else if (strcmp(attr, "next") == 0) {
+		p->next_name = spec_strdup(val);
+	} else if (strcmp(attr, "frag") == 0) {
+		p->frag_name = spec_strdup(val);
+	} else if (strcmp(attr, "present") == 0) {
+		p->present_name = spec_strdup(val);
+	} else if (strcmp(attr, "demux") == 0) {
+		p->demux_name = spec_strdup(val);
+	} else if (strcmp(attr, "id") == 0) {
+		if (spec_number(val, &p->id))
+			goto err_value;
+	} else if (strcmp(attr, "len") == 0) {
+		if (spec_number(val, &p->hdr_len) || p->hdr_len < 0)
+			goto err_value;
+	} else if (strcmp(attr, "varlen") == 0) {
+		struct proto_len *len = &p->var_len;
+
+		if (sscanf(val, "%i:%i:%i", &len->offset, &len->mask,
+					&len->scale) != 3 || !len->mask)
+			goto err_value;
+	} else if (strcmp(attr, "layer") == 0) {
+		for (i = 0; i < LAYER_MAX; i++) {
+			if (strcmp(val, layer_names[i]) == 0)
+				break;
+		}
+		if (i == LAYER_MAX)
+			goto err_value;
+
+		p->layer = i;
+	} else {
+		spec_error(ctx, "unknown attribute", attr);
+		return -1;
+	}
+
+	return 0;
+
+err_value:
+	spec_error(ctx, "wrong value", val);
+	return -1;
+}
+
+static int spec_proto_parse(struct spec_ctx *ctx, char *name)
+{
+	struct spec_proto *sp;
+	char *attr;
+
+	if (spec_proto_finish(ctx))
+		return -1;
+
+	if (!name) {
+		spec_error(ctx, "missing protocol name", "");
+		return -1;
+	}
+	if (proto_lookup(name)) {
+		spec_error(ctx, "protocol is already defined", name);
+		return -1;
+	}
+
+	sp = xmalloc(sizeof(*sp));
+	memset(sp, 0, sizeof(*sp));
+	sp->proto.layer = LAYER_5;
+	sp->proto.name = spec_strdup(name);
+	ctx->sp = sp;
+
+	while ((attr = strtok(NULL, " \t"))) {
+		if (spec_proto_attr(ctx, &sp->proto, attr))
+			return -1;
+	}
+
+	return 0;
+}
+
+static int spec_field_parse(struct spec_ctx *ctx, char *name)
+{
+	char *offset = strtok(NULL, " \t");
+	char *len = strtok(NULL, " \t");
+	char *mask = strtok(NULL, " \t");
+	struct proto_field *f;
+	char *full_name;
+	int i;
+
+	if (!ctx->sp) {
+		spec_error(ctx, "field is out of protocol", name ? name : "");
+		return -1;
+	}
+	if (!name || !offset || !len) {
+		spec_error(ctx, "field needs name, offset and width",
+				name ? name : "");
+		return -1;
+	}
+	if (ctx->fields_count == SPEC_FIELDS_MAX) {
+		spec_error(ctx, "too many fields", name);
+		return -1;
+	}
+
+	f = &ctx->fields[ctx->fields_count];
+	memset(f, 0, sizeof(*f));
+
+	if (spec_number(offset, &f->offset) || f->offset < 0) {
+		spec_error(ctx, "wrong offset", offset);
+		return -1;
+	}
+	if (spec_number(len, &f->len) ||
+			(f->len != 1 && f->len != 2 && f->len != 4)) {
+		spec_error(ctx, "wrong width", len);
+		return -1;
+	}
+	if (mask && spec_number(mask, &f->mask)) {
+		spec_error(ctx, "wrong mask", mask);
+		return -1;
+	}
+
+	full_name = xmalloc(strlen(ctx->sp->proto.name) + strlen(name) + 2);
+	sprintf(full_name, "%s.%s", ctx->sp->proto.name, name);
+
+	for (i = 0; i < ctx->fields_count; i++) {
+		if (strcmp(ctx->fields[i].name, full_name) == 0) {
+			spec_error(ctx, "field is already defined", full_name);
+			xfree(full_name);
+			return -1;
+		}
+	}
+
+	f->name = full_name;
+	ctx->fields_count++;
+	return 0;
+}
+
+int proto_spec_load(char *path)
+{
+	struct spec_ctx ctx = { .path = path };
+	char line[SPEC_LINE_MAX];
+	int ret = 0;
+	char *word;
+	FILE *fp;
+	int i;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		fprintf(stderr, "error: can't open protocols file '%s'\n", path);
+		return -1;
+	}
+
+	while (!ret && fgets(line, sizeof(line), fp)) {
+		ctx.line++;
+
+		line[strcspn(line, "#\r\n")] = '\0';
+
+		word = strtok(line, " \t");
+		if (!word)
+			continue;
+
+		if (strcmp(word, "proto") == 0) {
+			ret = spec_proto_parse(&ctx, strtok(NULL, " \t"));
+		} else if (strcmp(word, "field") == 0) {
+			ret = spec_field_parse(&ctx, strtok(NULL, " \t"));
+		} else {
+			spec_error(&ctx, "unknown keyword", word);
+			ret = -1;
+		}
+	}
+
+	if (!ret)
+		ret = spec_proto_finish(&ctx);
+
+	/* protocol which is not registered yet */
+	if (ctx.sp) {
+		for (i = 0; i < ctx.fields_count; i++)
+			xfree(ctx.fields[i].name);
+		spec_proto_free(ctx.sp);
+	}
+
+	fclose(fp);
+	return ret;
+}
+
+void proto_spec_unload(void)
+{
+	struct spec_proto *sp, *tmp;
+
+	list_for_each_entry_safe(sp, tmp, &spec_protos, list) {
+		list_del(&sp->list);
+		spec_proto_free(sp);
+	}
+}
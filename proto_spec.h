@@ -0,0 +1,7 @@
+#ifndef __PROTO_SPEC_H__
+#define __PROTO_SPEC_H__
+
+int proto_spec_load(char *path);
+void proto_spec_unload(void);
+
+#endif
@@ -0,0 +1,70 @@
+/*
+ * skb_protos.c	socket buffer metadata pseudo protocol
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * Authors:	Vadim Kochan <vadim4j@gmail.com>
+ */
+
+#include "proto.h"
+
+#define SKB_NAME(fld) "skb."fld
+
+/* loaded by the kernel from the skb, not from the packet bytes */
+struct proto_field skb_fields[] = {
+	{
+		.name	= SKB_NAME("protocol"),
+		.offset	= SKF_AD_OFF + SKF_AD_PROTOCOL,
+		.len	= 4,
+	},
+	{
+		.name	= SKB_NAME("pkttype"),
+		.offset	= SKF_AD_OFF + SKF_AD_PKTTYPE,
+		.len	= 4,
+	},
+	{
+		.name	= SKB_NAME("ifindex"),
+		.offset	= SKF_AD_OFF + SKF_AD_IFINDEX,
+		.len	= 4,
+	},
+	{
+		.name	= SKB_NAME("mark"),
+		.offset	= SKF_AD_OFF + SKF_AD_MARK,
+		.len	= 4,
+	},
+	{
+		.name	= SKB_NAME("queue"),
+		.offset	= SKF_AD_OFF + SKF_AD_QUEUE,
+		.len	= 4,
+	},
+	{
+		.name	= SKB_NAME("hatype"),
+		.offset	= SKF_AD_OFF + SKF_AD_HATYPE,
+		.len	= 4,
+	},
+	{
+		.name	= SKB_NAME("rxhash"),
+		.offset	= SKF_AD_OFF + SKF_AD_RXHASH,
+		.len	= 4,
+	},
+	{
+		.name	= SKB_NAME("cpu"),
+		.offset	= SKF_AD_OFF + SKF_AD_CPU,
+		.len	= 4,
+	},
+	{},
+};
+
+struct proto skb_proto = {
+	.layer	= LAYER_LINK,
+	.name	= "skb",
+	.fields = skb_fields,
+};
+
+void skb_protos_register(void)
+{
+	proto_register(&skb_proto);
+}
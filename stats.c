@@ -0,0 +1,130 @@
+/*
+ * stats.c	compiler statistics
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * Authors:	Vadim Kochan <vadim4j@gmail.com>
+ */
+
+#include <time.h>
+#include <string.h>
+
+#include "stats.h"
+#include "xmalloc.h"
+
+static const char *stage_names[STAGE_MAX] = {
+	[STAGE_PARSE]		= "parse",
+	[STAGE_CODEGEN]		= "codegen",
+	[STAGE_OPTIMIZE]	= "optimize",
+	[STAGE_EMIT]		= "emit",
+};
+
+static struct compiler_stats *stats;
+static size_t mem_base;
+
+void stats_begin(struct compiler_stats *st)
+{
+	stats = st;
+	if (!stats)
+		return;
+
+	memset(stats, 0, sizeof(*stats));
+
+	mem_base = xmalloc_mem_used();
+	xmalloc_mem_peak_reset();
+}
+
+void stats_end(void)
+{
+	if (!stats)
+		return;
+
+	stats->mem_peak = xmalloc_mem_peak() - mem_base;
+	stats = NULL;
+}
+
+struct compiler_stats *stats_current(void)
+{
+	return stats;
+}
+
+uint64_t stats_timer_start(void)
+{
+	struct timespec ts;
+
+	if (!stats)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void stats_timer_stop(stats_stage_t stage, uint64_t start)
+{
+	if (!stats)
+		return;
+
+	stats->stage_ns[stage] += stats_timer_start() - start;
+}
+
+const char *stats_stage_name(stats_stage_t stage)
+{
+	return stage_names[stage];
+}
+
+static void stats_print_text(FILE *fp, struct compiler_stats *st)
+{
+	uint64_t total = 0;
+	int i;
+
+	for (i = 0; i < STAGE_MAX; i++) {
+		fprintf(fp, "%-10s %12.3f ms\n", stage_names[i],
+				st->stage_ns[i] / 1e6);
+		total += st->stage_ns[i];
+	}
+	fprintf(fp, "%-10s %12.3f ms\n", "total", total / 1e6);
+
+	fprintf(fp, "optimizer iterations: %d\n", st->opt_iterations);
+	fprintf(fp, "instructions: %d generated, %d emitted\n",
+			st->instrs_generated, st->instrs_emitted);
+	fprintf(fp, "  removed by constant folding: %d\n",
+			st->instrs_removed_fold);
+	fprintf(fp, "  removed by dead code elimination: %d\n",
+			st->instrs_removed_dead);
+	fprintf(fp, "  removed by peephole rules: %d\n",
+			st->instrs_removed_peephole);
+	fprintf(fp, "blocks: %d\n", st->block_count);
+	fprintf(fp, "peak IR memory: %zu bytes\n", st->mem_peak);
+}
+
+static void stats_print_json(FILE *fp, struct compiler_stats *st)
+{
+	int i;
+
+	fprintf(fp, "{\"time_ns\":{");
+	for (i = 0; i < STAGE_MAX; i++)
+		fprintf(fp, "%s\"%s\":%llu", i ? "," : "", stage_names[i],
+				(unsigned long long)st->stage_ns[i]);
+	fprintf(fp, "},");
+
+	fprintf(fp, "\"opt_iterations\":%d,", st->opt_iterations);
+	fprintf(fp, "\"instrs\":{\"generated\":%d,\"emitted\":%d,"
+			"\"removed_fold\":%d,\"removed_dead\":%d,"
+			"\"removed_peephole\":%d},",
+			st->instrs_generated, st->instrs_emitted,
+			st->instrs_removed_fold, st->instrs_removed_dead,
+			st->instrs_removed_peephole);
+	fprintf(fp, "\"blocks\":%d,", st->block_count);
+	fprintf(fp, "\"mem_peak\":%zu}\n", st->mem_peak);
+}
+
+void stats_print(FILE *fp, struct compiler_stats *st, stats_fmt_t fmt)
+{
+	if (fmt == STATS_FMT_JSON)
+		stats_print_json(fp, st);
+	else
+		stats_print_text(fp, st);
+}
@@ -0,0 +1,45 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum {
+	STAGE_PARSE,
+	STAGE_CODEGEN,
+	STAGE_OPTIMIZE,
+	STAGE_EMIT,
+
+	/* must be last */
+	STAGE_MAX,
+} stats_stage_t;
+
+typedef enum {
+	STATS_FMT_TEXT,
+	STATS_FMT_JSON,
+} stats_fmt_t;
+
+struct compiler_stats {
+	uint64_t stage_ns[STAGE_MAX];
+	int opt_iterations;
+	int instrs_generated;
+	int instrs_removed_fold;
+	int instrs_removed_dead;
+	int instrs_removed_peephole;
+	int instrs_emitted;
+	int block_count;
+	size_t mem_peak;
+};
+
+void stats_begin(struct compiler_stats *st);
+void stats_end(void);
+struct compiler_stats *stats_current(void);
+
+uint64_t stats_timer_start(void);
+void stats_timer_stop(stats_stage_t stage, uint64_t start);
+
+const char *stats_stage_name(stats_stage_t stage);
+void stats_print(FILE *fp, struct compiler_stats *st, stats_fmt_t fmt);
+
+#endif
@@ -0,0 +1,297 @@
+/*
+ * trans_protos.c	transport layer protos
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * Authors:	Vadim Kochan <vadim4j@gmail.com>
+ */
+
+#include "proto.h"
+
+#define TCP_NAME(fld) "tcp."fld
+#define UDP_NAME(fld) "udp."fld
+#define ICMP_NAME(fld) "icmp."fld
+#define TCP6_NAME(fld) "tcp6."fld
+#define UDP6_NAME(fld) "udp6."fld
+#define ICMP6_NAME(fld) "icmp6."fld
+
+struct proto_field tcp_fields[] = {
+	{
+		.name	= TCP_NAME("sport"),
+		.offset	= 0,
+		.len	= 2,
+	},
+	{
+		.name	= TCP_NAME("dport"),
+		.offset	= 2,
+		.len	= 2,
+	},
+	{
+		.name	= TCP_NAME("seq"),
+		.offset	= 4,
+		.len	= 4,
+	},
+	{
+		.name	= TCP_NAME("ack"),
+		.offset	= 8,
+		.len	= 4,
+	},
+	{
+		.name	= TCP_NAME("off"),
+		.offset	= 12,
+		.len	= 1,
+		.mask	= 0xf0,
+	},
+	{
+		.name	= TCP_NAME("flags"),
+		.offset	= 13,
+		.len	= 1,
+	},
+	{
+		.name	= TCP_NAME("win"),
+		.offset	= 14,
+		.len	= 2,
+	},
+	{
+		.name	= TCP_NAME("csum"),
+		.offset	= 16,
+		.len	= 2,
+	},
+	{
+		.name	= TCP_NAME("urg"),
+		.offset	= 18,
+		.len	= 2,
+	},
+	{},
+};
+
+struct proto tcp_proto = {
+	.layer	= LAYER_TRANSPORT,
+	.name	= "tcp",
+	.id	= 6,
+	.lower_name = "ipv4",
+	.var_len = {
+		.offset	= 12,
+		.mask	= 0xf0,
+		.scale	= 4,
+	},
+	.fields = tcp_fields,
+};
+
+struct proto_field udp_fields[] = {
+	{
+		.name	= UDP_NAME("sport"),
+		.offset	= 0,
+		.len	= 2,
+	},
+	{
+		.name	= UDP_NAME("dport"),
+		.offset	= 2,
+		.len	= 2,
+	},
+	{
+		.name	= UDP_NAME("len"),
+		.offset	= 4,
+		.len	= 2,
+	},
+	{
+		.name	= UDP_NAME("csum"),
+		.offset	= 6,
+		.len	= 2,
+	},
+	{},
+};
+
+struct proto udp_proto = {
+	.layer	= LAYER_TRANSPORT,
+	.name	= "udp",
+	.id	= 17,
+	.lower_name = "ipv4",
+	.hdr_len = 8,
+	.fields = udp_fields,
+};
+
+struct proto_field icmp_fields[] = {
+	{
+		.name	= ICMP_NAME("type"),
+		.offset	= 0,
+		.len	= 1,
+	},
+	{
+		.name	= ICMP_NAME("code"),
+		.offset	= 1,
+		.len	= 1,
+	},
+	{
+		.name	= ICMP_NAME("csum"),
+		.offset	= 2,
+		.len	= 2,
+	},
+	{},
+};
+
+struct proto icmp_proto = {
+	.layer	= LAYER_TRANSPORT,
+	.name	= "icmp",
+	.id	= 1,
+	.lower_name = "ipv4",
+	.hdr_len = 8,
+	.fields = icmp_fields,
+};
+
+/* the same headers carried in IPv6, behind its extension headers */
+
+struct proto_field tcp6_fields[] = {
+	{
+		.name	= TCP6_NAME("sport"),
+		.offset	= 0,
+		.len	= 2,
+	},
+	{
+		.name	= TCP6_NAME("dport"),
+		.offset	= 2,
+		.len	= 2,
+	},
+	{
+		.name	= TCP6_NAME("seq"),
+		.offset	= 4,
+		.len	= 4,
+	},
+	{
+		.name	= TCP6_NAME("ack"),
+		.offset	= 8,
+		.len	= 4,
+	},
+	{
+		.name	= TCP6_NAME("off"),
+		.offset	= 12,
+		.len	= 1,
+		.mask	= 0xf0,
+	},
+	{
+		.name	= TCP6_NAME("flags"),
+		.offset	= 13,
+		.len	= 1,
+	},
+	{
+		.name	= TCP6_NAME("win"),
+		.offset	= 14,
+		.len	= 2,
+	},
+	{
+		.name	= TCP6_NAME("csum"),
+		.offset	= 16,
+		.len	= 2,
+	},
+	{
+		.name	= TCP6_NAME("urg"),
+		.offset	= 18,
+		.len	= 2,
+	},
+	{},
+};
+
+struct proto tcp6_proto = {
+	.layer	= LAYER_TRANSPORT,
+	.name	= "tcp6",
+	.id	= 6,
+	.lower_name = "ipv6",
+	.var_len = {
+		.offset	= 12,
+		.mask	= 0xf0,
+		.scale	= 4,
+	},
+	.fields = tcp6_fields,
+};
+
+struct proto_field udp6_fields[] = {
+	{
+		.name	= UDP6_NAME("sport"),
+		.offset	= 0,
+		.len	= 2,
+	},
+	{
+		.name	= UDP6_NAME("dport"),
+		.offset	= 2,
+		.len	= 2,
+	},
+	{
+		.name	= UDP6_NAME("len"),
+		.offset	= 4,
+		.len	= 2,
+	},
+	{
+		.name	= UDP6_NAME("csum"),
+		.offset	= 6,
+		.len	= 2,
+	},
+	{},
+};
+
+struct proto udp6_proto = {
+	.layer	= LAYER_TRANSPORT,
+	.name	= "udp6",
+	.id	= 17,
+	.lower_name = "ipv6",
+	.hdr_len = 8,
+	.fields = udp6_fields,
+};
+
+struct proto_field icmp6_fields[] = {
+	{
+		.name	= ICMP6_NAME("type"),
+		.offset	= 0,
+		.len	= 1,
+	},
+	{
+		.name	= ICMP6_NAME("code"),
+		.offset	= 1,
+		.len	= 1,
+	},
+	{
+		.name	= ICMP6_NAME("csum"),
+		.offset	= 2,
+		.len	= 2,
+	},
+	{},
+};
+
+struct proto icmp6_proto = {
+	.layer	= LAYER_TRANSPORT,
+	.name	= "icmp6",
+	.id	= 58,
+	.lower_name = "ipv6",
+	.hdr_len = 8,
+	.fields = icmp6_fields,
+};
+
+/* data after the TCP header, matched by the byte patterns */
+
+struct proto payload_proto = {
+	.layer	= LAYER_5,
+	.name	= "payload",
+	.lower_name = "tcp",
+};
+
+struct proto payload6_proto = {
+	.layer	= LAYER_5,
+	.name	= "payload6",
+	.lower_name = "tcp6",
+};
+
+void trans_protos_register(void)
+{
+	proto_register(&tcp_proto);
+	proto_register(&udp_proto);
+	proto_register(&icmp_proto);
+
+	proto_register(&tcp6_proto);
+	proto_register(&udp6_proto);
+	proto_register(&icmp6_proto);
+
+	proto_register(&payload_proto);
+	proto_register(&payload6_proto);
+}
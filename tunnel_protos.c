@@ -0,0 +1,342 @@
+/*
+ * tunnel_protos.c	encapsulation protos and the inner ones they carry
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * Authors:	Vadim Kochan <vadim4j@gmail.com>
+ */
+
+/*
+ * The headers carried by an encapsulation are the "inner." copies of the
+ * network and transport protocols. They sit on top of the "inner" one,
+ * whose offset and protocol come from the decode of the first encapsulation
+ * which is there, so "inner.ipv4.src" is matched in any of the tunnels.
+ * An inner ethernet frame is skipped (without its tags).
+ *
+ * A protocol has a single lower one, so VXLAN and Geneve are only decoded
+ * over "udp" and GRE over "ipv4": a tunnel carried over IPv6 does not match
+ * and neither do its "inner." fields.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "list.h"
+#include "proto.h"
+#include "xmalloc.h"
+#include "proto_registers.h"
+
+#define VXLAN_NAME(fld) "vxlan."fld
+#define GENEVE_NAME(fld) "geneve."fld
+#define GRE_NAME(fld) "gre."fld
+#define MPLS_NAME(fld) "mpls."fld
+
+#define INNER_NAME	"inner"
+
+#define VXLAN_PORT	4789
+#define GENEVE_PORT	6081
+#define IPPROTO_GRE	47
+#define ETH_P_MPLS_UC	0x8847
+
+#define MPLS_LABELS_DEF	4
+
+struct proto_field vxlan_fields[] = {
+	{
+		.name	= VXLAN_NAME("flags"),
+		.offset	= 0,
+		.len	= 1,
+	},
+	{
+		.name	= VXLAN_NAME("vni"),
+		.offset	= 4,
+		.len	= 4,
+		.mask	= 0xffffff00,
+	},
+	{},
+};
+
+struct proto vxlan_proto = {
+	.layer	= LAYER_5,
+	.name	= "vxlan",
+	.id	= VXLAN_PORT,
+	.lower_name = "udp",
+	.demux_name = "udp.dport",
+	.hdr_len = 8,
+	.fields = vxlan_fields,
+	.encap = {
+		.type	= ENCAP_ETHER,
+	},
+};
+
+struct proto_field geneve_fields[] = {
+	{
+		.name	= GENEVE_NAME("ver"),
+		.offset	= 0,
+		.len	= 1,
+		.mask	= 0xc0,
+	},
+	{
+		.name	= GENEVE_NAME("optlen"),
+		.offset	= 0,
+		.len	= 1,
+		.mask	= 0x3f,
+	},
+	{
+		.name	= GENEVE_NAME("flags"),
+		.offset	= 1,
+		.len	= 1,
+	},
+	{
+		.name	= GENEVE_NAME("proto"),
+		.offset	= 2,
+		.len	= 2,
+	},
+	{
+		.name	= GENEVE_NAME("vni"),
+		.offset	= 4,
+		.len	= 4,
+		.mask	= 0xffffff00,
+	},
+	{},
+};
+
+struct proto geneve_proto = {
+	.layer	= LAYER_5,
+	.name	= "geneve",
+	.id	= GENEVE_PORT,
+	.lower_name = "udp",
+	.demux_name = "udp.dport",
+	.hdr_len = 8,
+	/* options are in 4 octet units */
+	.var_len = {
+		.offset	= 0,
+		.mask	= 0x3f,
+		.scale	= 4,
+	},
+	.fields = geneve_fields,
+	.encap = {
+		.type	= ENCAP_TYPE,
+		.type_name = GENEVE_NAME("proto"),
+	},
+};
+
+struct proto_field gre_fields[] = {
+	{
+		.name	= GRE_NAME("flags"),
+		.offset	= 0,
+		.len	= 2,
+		.mask	= 0xfff8,
+	},
+	{
+		.name	= GRE_NAME("ver"),
+		.offset	= 0,
+		.len	= 2,
+		.mask	= 0x7,
+	},
+	{
+		.name	= GRE_NAME("proto"),
+		.offset	= 2,
+		.len	= 2,
+	},
+	{},
+};
+
+struct proto gre_proto = {
+	.layer	= LAYER_NETWORK,
+	.name	= "gre",
+	.id	= IPPROTO_GRE,
+	.lower_name = "ipv4",
+	.hdr_len = 4,
+	/* checksum, key and sequence number */
+	.opts = {
+		.offset	= 0,
+		.len	= 4,
+		.flags	= { 0x8000, 0x2000, 0x1000 },
+	},
+	.fields = gre_fields,
+	.encap = {
+		.type	= ENCAP_TYPE,
+		.type_name = GRE_NAME("proto"),
+	},
+};
+
+/* the outer label, the stack is walked by the decode */
+struct proto_field mpls_fields[] = {
+	{
+		.name	= MPLS_NAME("label"),
+		.offset	= 0,
+		.len	= 4,
+		.mask	= 0xfffff000,
+	},
+	{
+		.name	= MPLS_NAME("tc"),
+		.offset	= 2,
+		.len	= 1,
+		.mask	= 0x0e,
+	},
+	{
+		.name	= MPLS_NAME("bos"),
+		.offset	= 2,
+		.len	= 1,
+		.mask	= 0x01,
+	},
+	{
+		.name	= MPLS_NAME("ttl"),
+		.offset	= 3,
+		.len	= 1,
+	},
+	{},
+};
+
+struct proto mpls_proto = {
+	.layer	= LAYER_NETWORK,
+	.name	= "mpls",
+	.id	= ETH_P_MPLS_UC,
+	.lower_name = "ether",
+	.hdr_len = 4,
+	.fields = mpls_fields,
+	.encap = {
+		.type	= ENCAP_LABELS,
+		.max	= MPLS_LABELS_DEF,
+	},
+};
+
+static struct proto *inner_encaps[] = {
+	&vxlan_proto,
+	&geneve_proto,
+	&gre_proto,
+	&mpls_proto,
+	NULL,
+};
+
+struct proto inner_proto = {
+	.layer	= LAYER_LINK,
+	.name	= INNER_NAME,
+	.encaps	= inner_encaps,
+};
+
+/* protocols which get their inner copies, lower ones first */
+static char *inner_names[] = {
+	"ipv4", "ipv6", "tcp", "udp", "icmp", "tcp6", "udp6", "icmp6",
+	"payload", "payload6", NULL,
+};
+
+struct inner_proto {
+	struct list_head list;
+	struct proto proto;
+};
+
+static LIST_HEAD(inner_protos);
+
+static char *inner_name(char *name)
+{
+	char *inner;
+
+	if (!name)
+		return NULL;
+
+	inner = xmalloc(strlen(INNER_NAME) + strlen(name) + 2);
+	sprintf(inner, INNER_NAME ".%s", name);
+	return inner;
+}
+
+static void inner_strfree(char *str)
+{
+	if (str)
+		xfree(str);
+}
+
+static void inner_proto_clone(struct proto *p)
+{
+	struct inner_proto *ip = xmalloc(sizeof(*ip));
+	struct proto *q = &ip->proto;
+	int count = 0;
+	int i;
+
+	memset(ip, 0, sizeof(*ip));
+
+	q->layer = p->layer;
+	q->name = inner_name(p->name);
+	q->id = p->id;
+	q->hdr_len = p->hdr_len;
+	q->var_len = p->var_len;
+	q->ext = p->ext;
+	q->opts = p->opts;
+
+	/* link layer is replaced by the decode */
+	if (p->lower->layer == LAYER_LINK) {
+		q->lower_name = xmalloc(sizeof(INNER_NAME));
+		strcpy(q->lower_name, INNER_NAME);
+	} else {
+		q->lower_name = inner_name(p->lower->name);
+	}
+
+	q->next_name = inner_name(p->next_name);
+	q->frag_name = inner_name(p->frag_name);
+	q->present_name = inner_name(p->present_name);
+	q->demux_name = inner_name(p->demux_name);
+
+	while (p->fields && p->fields[count].name)
+		count++;
+
+	q->fields = xmalloc(sizeof(struct proto_field) * (count + 1));
+	memset(q->fields, 0, sizeof(struct proto_field) * (count + 1));
+	for (i = 0; i < count; i++) {
+		q->fields[i] = p->fields[i];
+		q->fields[i].name = inner_name(p->fields[i].name);
+	}
+
+	proto_register(q);
+	list_add_tail(&ip->list, &inner_protos);
+}
+
+static void inner_proto_free(struct inner_proto *ip)
+{
+	struct proto *q = &ip->proto;
+	struct proto_field *f;
+
+	for (f = q->fields; f->name; f++)
+		xfree(f->name);
+	xfree(q->fields);
+
+	xfree(q->lower_name);
+	inner_strfree(q->next_name);
+	inner_strfree(q->frag_name);
+	inner_strfree(q->present_name);
+	inner_strfree(q->demux_name);
+	xfree(q->name);
+	xfree(ip);
+}
+
+/* should be called after the protocols which are copied */
+void tunnel_protos_register(void)
+{
+	struct proto *p;
+	int i;
+
+	proto_register(&vxlan_proto);
+	proto_register(&geneve_proto);
+	proto_register(&gre_proto);
+	proto_register(&mpls_proto);
+
+	proto_register(&inner_proto);
+
+	for (i = 0; inner_names[i]; i++) {
+		p = proto_lookup(inner_names[i]);
+		if (p && p->lower)
+			inner_proto_clone(p);
+	}
+}
+
+void tunnel_protos_unregister(void)
+{
+	struct inner_proto *ip, *tmp;
+
+	list_for_each_entry_safe(ip, tmp, &inner_protos, list) {
+		list_del(&ip->list);
+		inner_proto_free(ip);
+	}
+}
@@ -0,0 +1,247 @@
+/*
+ * verifier.c	checks of the kernel classic BPF verifier
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * Authors:	Vadim Kochan <vadim4j@gmail.com>
+ */
+
+/*
+ * The same checks the kernel does in bpf_check_classic() when the program
+ * is attached, so a program it would refuse is caught here with the
+ * offending instruction instead of an EINVAL from setsockopt(). Unlike the
+ * kernel all the violations are reported, not only the first one.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "verifier.h"
+#include "xmalloc.h"
+
+static bool verify_code_allowed(uint16_t code)
+{
+	switch (code) {
+	case BPF_ALU | BPF_ADD | BPF_K:
+	case BPF_ALU | BPF_ADD | BPF_X:
+	case BPF_ALU | BPF_SUB | BPF_K:
+	case BPF_ALU | BPF_SUB | BPF_X:
+	case BPF_ALU | BPF_MUL | BPF_K:
+	case BPF_ALU | BPF_MUL | BPF_X:
+	case BPF_ALU | BPF_DIV | BPF_K:
+	case BPF_ALU | BPF_DIV | BPF_X:
+	case BPF_ALU | BPF_MOD | BPF_K:
+	case BPF_ALU | BPF_MOD | BPF_X:
+	case BPF_ALU | BPF_AND | BPF_K:
+	case BPF_ALU | BPF_AND | BPF_X:
+	case BPF_ALU | BPF_OR | BPF_K:
+	case BPF_ALU | BPF_OR | BPF_X:
+	case BPF_ALU | BPF_XOR | BPF_K:
+	case BPF_ALU | BPF_XOR | BPF_X:
+	case BPF_ALU | BPF_LSH | BPF_K:
+	case BPF_ALU | BPF_LSH | BPF_X:
+	case BPF_ALU | BPF_RSH | BPF_K:
+	case BPF_ALU | BPF_RSH | BPF_X:
+	case BPF_ALU | BPF_NEG:
+	case BPF_LD | BPF_W | BPF_ABS:
+	case BPF_LD | BPF_H | BPF_ABS:
+	case BPF_LD | BPF_B | BPF_ABS:
+	case BPF_LD | BPF_W | BPF_LEN:
+	case BPF_LD | BPF_W | BPF_IND:
+	case BPF_LD | BPF_H | BPF_IND:
+	case BPF_LD | BPF_B | BPF_IND:
+	case BPF_LD | BPF_IMM:
+	case BPF_LD | BPF_MEM:
+	case BPF_LDX | BPF_W | BPF_LEN:
+	case BPF_LDX | BPF_B | BPF_MSH:
+	case BPF_LDX | BPF_IMM:
+	case BPF_LDX | BPF_MEM:
+	case BPF_ST:
+	case BPF_STX:
+	case BPF_MISC | BPF_TAX:
+	case BPF_MISC | BPF_TXA:
+	case BPF_RET | BPF_K:
+	case BPF_RET | BPF_A:
+	case BPF_JMP | BPF_JA:
+	case BPF_JMP | BPF_JEQ | BPF_K:
+	case BPF_JMP | BPF_JEQ | BPF_X:
+	case BPF_JMP | BPF_JGE | BPF_K:
+	case BPF_JMP | BPF_JGE | BPF_X:
+	case BPF_JMP | BPF_JGT | BPF_K:
+	case BPF_JMP | BPF_JGT | BPF_X:
+	case BPF_JMP | BPF_JSET | BPF_K:
+	case BPF_JMP | BPF_JSET | BPF_X:
+		return true;
+	}
+
+	return false;
+}
+
+static bool verify_ancillary(uint32_t k)
+{
+	switch (k - SKF_AD_OFF) {
+	case SKF_AD_PROTOCOL:
+	case SKF_AD_PKTTYPE:
+	case SKF_AD_IFINDEX:
+	case SKF_AD_NLATTR:
+	case SKF_AD_NLATTR_NEST:
+	case SKF_AD_MARK:
+	case SKF_AD_QUEUE:
+	case SKF_AD_HATYPE:
+	case SKF_AD_RXHASH:
+	case SKF_AD_CPU:
+	case SKF_AD_ALU_XOR_X:
+	case SKF_AD_VLAN_TAG:
+	case SKF_AD_VLAN_TAG_PRESENT:
+	case SKF_AD_PAY_OFFSET:
+	case SKF_AD_RANDOM:
+#ifdef SKF_AD_VLAN_TPID
+	case SKF_AD_VLAN_TPID:
+#endif
+		return true;
+	}
+
+	return false;
+}
+
+static bool verify_is_cond_jmp(uint16_t code)
+{
+	return BPF_CLASS(code) == BPF_JMP && BPF_OP(code) != BPF_JA;
+}
+
+/*
+ * The scratch memory words are only valid after a store on every path to
+ * the load, a jump hands its set to the target and the fall through after
+ * it starts with all of them.
+ */
+static int verify_mem(struct sock_filter *f, int count, bool *bad,
+		verify_report_t report, void *arg)
+{
+	uint32_t *masks = xmalloc(sizeof(*masks) * count);
+	uint32_t memvalid = 0;
+	char msg[64];
+	int errors = 0;
+	int pc;
+
+	for (pc = 0; pc < count; pc++)
+		masks[pc] = ~0;
+
+	for (pc = 0; pc < count; pc++) {
+		uint16_t code = f[pc].code;
+
+		memvalid &= masks[pc];
+		if (bad[pc])
+			continue;
+
+		switch (code) {
+		case BPF_ST:
+		case BPF_STX:
+			memvalid |= 1 << f[pc].k;
+			break;
+		case BPF_LD | BPF_MEM:
+		case BPF_LDX | BPF_MEM:
+			if (!(memvalid & (1 << f[pc].k))) {
+				snprintf(msg, sizeof(msg),
+						"read of M[%u] before it is stored",
+						f[pc].k);
+				report(pc, msg, arg);
+				errors++;
+			}
+			break;
+		case BPF_JMP | BPF_JA:
+			masks[pc + 1 + f[pc].k] &= memvalid;
+			memvalid = ~0;
+			break;
+		default:
+			if (!verify_is_cond_jmp(code))
+				break;
+			masks[pc + 1 + f[pc].jt] &= memvalid;
+			masks[pc + 1 + f[pc].jf] &= memvalid;
+			memvalid = ~0;
+		}
+	}
+
+	xfree(masks);
+	return errors;
+}
+
+int verify(struct sock_filter *f, int count, verify_report_t report,
+		void *arg)
+{
+	char msg[64];
+	int errors = 0;
+	bool *bad;
+	int pc;
+
+	if (count <= 0 || count > BPF_MAXINSNS) {
+		snprintf(msg, sizeof(msg), "%d instructions, at most %d are allowed",
+				count, BPF_MAXINSNS);
+		report(-1, msg, arg);
+		return 1;
+	}
+
+	bad = xmalloc(sizeof(*bad) * count);
+	memset(bad, 0, sizeof(*bad) * count);
+
+	for (pc = 0; pc < count; pc++) {
+		uint16_t code = f[pc].code;
+		uint32_t k = f[pc].k;
+
+		msg[0] = '\0';
+
+		if (!verify_code_allowed(code)) {
+			snprintf(msg, sizeof(msg), "invalid opcode 0x%02x", code);
+		} else if (code == (BPF_ALU | BPF_DIV | BPF_K) ||
+				code == (BPF_ALU | BPF_MOD | BPF_K)) {
+			if (k == 0)
+				snprintf(msg, sizeof(msg), "%s by constant 0",
+						BPF_OP(code) == BPF_DIV ?
+						"division" : "modulo");
+		} else if (code == (BPF_ALU | BPF_LSH | BPF_K) ||
+				code == (BPF_ALU | BPF_RSH | BPF_K)) {
+			if (k >= 32)
+				snprintf(msg, sizeof(msg),
+						"shift by %u is out of range", k);
+		} else if (code == (BPF_LD | BPF_MEM) ||
+				code == (BPF_LDX | BPF_MEM) ||
+				code == BPF_ST || code == BPF_STX) {
+			if (k >= BPF_MEMWORDS)
+				snprintf(msg, sizeof(msg), "M[%u] is out of range", k);
+		} else if (code == (BPF_JMP | BPF_JA)) {
+			if (k >= (uint32_t)(count - pc - 1))
+				snprintf(msg, sizeof(msg), "jump by %u is out of range", k);
+		} else if (verify_is_cond_jmp(code)) {
+			if (pc + f[pc].jt + 1 >= count || pc + f[pc].jf + 1 >= count)
+				snprintf(msg, sizeof(msg),
+						"jump by %u/%u is out of range",
+						f[pc].jt, f[pc].jf);
+		} else if (BPF_CLASS(code) == BPF_LD && BPF_MODE(code) == BPF_ABS) {
+			if (k >= (uint32_t)SKF_AD_OFF && !verify_ancillary(k))
+				snprintf(msg, sizeof(msg),
+						"unknown ancillary offset %d",
+						(int)(k - SKF_AD_OFF));
+		}
+
+		if (msg[0]) {
+			report(pc, msg, arg);
+			bad[pc] = true;
+			errors++;
+		}
+	}
+
+	if (f[count - 1].code != (BPF_RET | BPF_K) &&
+			f[count - 1].code != (BPF_RET | BPF_A)) {
+		report(count - 1, "program does not end with ret", arg);
+		errors++;
+	}
+
+	errors += verify_mem(f, count, bad, report, arg);
+
+	xfree(bad);
+	return errors;
+}
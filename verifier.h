@@ -0,0 +1,12 @@
+#ifndef __VERIFIER_H__
+#define __VERIFIER_H__
+
+#include <linux/filter.h>
+
+/* idx is the offending instruction, -1 for the whole program */
+typedef void (*verify_report_t)(int idx, const char *msg, void *arg);
+
+int verify(struct sock_filter *f, int count, verify_report_t report,
+		void *arg);
+
+#endif
@@ -11,9 +11,14 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <malloc.h>
+
+static size_t mem_used;
+static size_t mem_peak;
 
 void *xmalloc(size_t size)
 {
+	size_t used;
 	void *ptr;
 
 	if (size == 0) {
@@ -23,9 +28,16 @@ void *xmalloc(size_t size)
 
 	ptr = malloc(size);
 	if (ptr == NULL) {
-		printf("xmalloc: Can't allocate %d bytes of memory\n", size);
+		printf("xmalloc: Can't allocate %zu bytes of memory\n", size);
 		exit(-1);
 	}
+
+	used = __atomic_add_fetch(&mem_used, malloc_usable_size(ptr),
+			__ATOMIC_RELAXED);
+	if (used > __atomic_load_n(&mem_peak, __ATOMIC_RELAXED))
+		__atomic_store_n(&mem_peak, used, __ATOMIC_RELAXED);
+
+	return ptr;
 }
 
 void xfree(void *ptr)
@@ -35,5 +47,21 @@ void xfree(void *ptr)
 		exit(-1);
 	}
 
+	__atomic_sub_fetch(&mem_used, malloc_usable_size(ptr), __ATOMIC_RELAXED);
 	free(ptr);
 }
+
+size_t xmalloc_mem_used(void)
+{
+	return __atomic_load_n(&mem_used, __ATOMIC_RELAXED);
+}
+
+size_t xmalloc_mem_peak(void)
+{
+	return __atomic_load_n(&mem_peak, __ATOMIC_RELAXED);
+}
+
+void xmalloc_mem_peak_reset(void)
+{
+	__atomic_store_n(&mem_peak, xmalloc_mem_used(), __ATOMIC_RELAXED);
+}
@@ -6,4 +6,8 @@
 void *xmalloc(size_t size);
 void xfree(void *ptr);
 
+size_t xmalloc_mem_used(void);
+size_t xmalloc_mem_peak(void);
+void xmalloc_mem_peak_reset(void);
+
 #endif